@@ -14,25 +14,34 @@
 #include <stdint.h>
 
 /**
- * @brief Maximum of solutions in sharedmemory
+ * @brief Default number of slots of the solution ring in sharedmemory, the supervisor can be given another one
  * 
  */
 #define MAX_DATA 50
 
 /**
- * @brief The maximum edges in a solution which is allowed
+ * @brief Default maximum of edges in a solution which is allowed, the supervisor can be given another one
  * 
  */
 #define MAX_EDGES 8
 
 /**
- * @brief Structure of one node in the graph
+ * @brief Edges which fit into one slot of the solution ring next to its sequence and the number of edges
  * 
  */
-typedef struct node{
-	int nodeIdx;
-	int8_t color;
-} node_t;
+#define SLOT_EDGES 6
+
+/**
+ * @brief Largest maximum of edges in a solution, the number of its slots and the bound one edge above it still fit into an int
+ * 
+ */
+#define MAX_EDGES_LIMIT (INT32_MAX - SLOT_EDGES)
+
+/**
+ * @brief Bytes after the colors of a graph, the conflict check reads 4 bytes at every node
+ * 
+ */
+#define COLOR_PADDING 3
 
 /**
  * @brief Structure of one edge in the graph
@@ -44,27 +53,94 @@ typedef struct edge{
 } edge_t;
 
 /**
- * @brief Structure of one possible graph solution
+ * @brief Structure of the graph of a generator, the node ids of the input are remapped to 0..nodesCount-1
+ * edges holds the edges like they were given so they can be written into solutions
+ * firstNodes and secondNodes hold the remapped nodes of every edge
+ * the neighbors of node i are adjacency[adjacencyStart[i]] to adjacency[adjacencyStart[i+1]-1], self loops are left out
+ * and only counted in selfLoops because they can't be removed by any color
+ * colors holds the color of every remapped node and COLOR_PADDING bytes more, so 4 bytes can be read at every node
+ * 
+ */
+typedef struct graph{
+	int nodesCount;
+	int edgesCount;
+	int selfLoops;
+	edge_t *edges;
+	int *firstNodes;
+	int *secondNodes;
+	int *adjacencyStart;
+	int *adjacency;
+	uint8_t *colors;
+} graph_t;
+
+/**
+ * @brief State of a local search on the colors of a graph
+ * neighborColors holds for every node and color how many neighbors of the node have that color
+ * conflictedNodes holds every node which has a neighbor with the same color, conflictedPositions holds the position
+ * of every node in conflictedNodes or -1
+ * conflicts is the number of edges between nodes with the same color without self loops, bestConflicts the lowest
+ * number since the last restart and stale the steps since it was reached
+ * tabu holds for every node and color the iteration until the node mustn't take that color again
+ * random is the state of the random number generator of the thread which runs the search
+ * 
+ */
+typedef struct search{
+	int *neighborColors;
+	int *conflictedNodes;
+	int *conflictedPositions;
+	int conflictedCount;
+	int conflicts;
+	int bestConflicts;
+	long stale;
+	unsigned long iteration;
+	unsigned long *tabu;
+	uint64_t random[4];
+} search_t;
+
+/**
+ * @brief Structure of one possible graph solution, edges has room for the maximum edges of the supervisor
  * 
  */
 typedef struct solution{
-	edge_t edges[MAX_EDGES];
+	edge_t *edges;
 	int numberOfEdges; 
 } solution_t;
 
 /**
- * @brief Structure of my shared memory which simulates the circular buffer
- * solutions contains every genereated solution
+ * @brief One slot of the solution ring, sequence is the position the slot can be written at
+ * or the position + 1 once the solution of that position is written
+ * a solution takes as many slots as its edges need, numberOfEdges is only set in its first slot
+ * 
+ */
+typedef struct slot{
+	unsigned long sequence;
+	int numberOfEdges;
+	edge_t edges[SLOT_EDGES];
+} __attribute__((aligned(64))) slot_t;
+
+/**
+ * @brief Structure of my shared memory which holds the lock-free circular buffer
  * quit marks if everything should be terminated: 0=normal 1=shutdown
- * write is the current writing position for all generators
- * readPos is the current reading position for the supervisor
- * shmTracker tracks all generated generators to free them from waiting   
+ * shmTracker tracks all generated generators to free them from waiting
+ * bestEdges is the number of edges of the best solution the supervisor has, generators only write better solutions
+ * supervisorSleeping and generatorsSleeping tell if someone waits on the used or free semaphore
+ * capacity is the number of slots and maxEdges the maximum edges of a solution, both are set by the supervisor
+ * and the generators size their solutions with them
+ * writePos is the next writing position for all generators
+ * readPos is the next reading position for the supervisor
+ * both positions only grow, they live in their own cache lines so writers and the reader don't slow each other down
+ * solutions contains every genereated solution, the shared memory ends after capacity slots
  * 
  */
 typedef struct shm{
-	solution_t solutions[MAX_DATA];
 	volatile int quit;
-	volatile int write;
-	volatile int readPos;
 	volatile int shmTracker;
+	int bestEdges;
+	int supervisorSleeping;
+	int generatorsSleeping;
+	int capacity;
+	int maxEdges;
+	unsigned long writePos __attribute__((aligned(64)));
+	unsigned long readPos __attribute__((aligned(64)));
+	slot_t solutions[];
 } shm_t;
\ No newline at end of file
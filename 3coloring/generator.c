@@ -10,36 +10,74 @@
  */
 #include <regex.h>
 #include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "3color.h"
 #include "semaphore.c"
 #include "sharedmemory.c"
+#include "ringbuffer.c"
+#include "random.c"
 
 #define PROGRAM_NAME "./generator"
 
+/**
+ * @brief Steps a local search makes before it returns to check for termination and the best solution of the supervisor
+ * 
+ */
+#define SEARCH_STEPS 1024
+
+/**
+ * @brief Steps without a new lowest number of conflicts after which a local search starts with new random colors
+ * 
+ */
+#define SEARCH_RESTART 100000
+
+/**
+ * @brief Search threads per online CPU a generator may start at most
+ * 
+ */
+#define THREADS_PER_CPU 4
+
 static volatile sig_atomic_t quit = 0;
 static int shmfd = -1;
 static shm_t *solution_buffer = NULL;
+static size_t shmSize = 0;
 static sem_t *freeSem = NULL;
 static sem_t *usedSem = NULL;
-static sem_t *writeSem = NULL; 
+
+// the threads hand their solutions to the main thread which is the only one writing them
+static pthread_mutex_t publishMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publishCond = PTHREAD_COND_INITIALIZER;
+static solution_t pendingSolution;
+static int hasPendingSolution = 0;
+// the best solution any thread of this generator found, the supervisor may not have read it yet
+static int processBest = 0;
+// the maximum edges of a solution the supervisor allows
+static int maxEdges = 0;
 
 /**
  * @brief Function which is called when the input is wrong
  * 
  */
 static void wrongInputError(void){
-	fprintf(stderr, "Use: %s d-d d-d d-d where d is an integer.\n",PROGRAM_NAME);
+	fprintf(stderr, "Use: %s [-a random|minconflicts|tabu] [-j threads] [-s seed] d-d d-d d-d where d is an integer.\n",PROGRAM_NAME);
 	exit(EXIT_FAILURE);
 }
 
 /**
- * @brief Handles the signal when detected and sets quit to 1 so generator terminates
+ * @brief Handles the signal when detected and sets quit to 1 so generator terminates, only the main thread gets it
+ * and it may sleep until the ring has free slots so it is woken up
  * 
  * @param signal 
  */
 static void handleSignal(int signal) { 
 	quit = 1; 
+	if(freeSem != NULL){
+		sem_post(freeSem);
+	}
 }
 
 /**
@@ -53,37 +91,16 @@ static void listenToSignal(void){
 }
 
 /**
- * @brief checks if a node with the nodeIdx already exists in the nodes array 1 if yes 0 if not
+ * @brief compares two node ids for qsort and bsearch
  * 
- * @param nodeIdx 
- * @param currLen 
- * @param nodes 
+ * @param a 
+ * @param b 
  * @return int 
  */
-static int checkNodesExisting(int nodeIdx, int currLen, node_t **nodes){
-	for(int i = 0; i < currLen; i++){
-		if (nodeIdx == (*nodes)[i].nodeIdx){
-            return 1;
-		}
-	}
-	return 0;
-}
-
-/**
- * @brief adds node if not alreay in nodes array to the nodes array 1 if successfull 0 if not
- * 
- * @param nodeIdx 
- * @param currLen 
- * @param nodes 
- * @return int 
- */
-static int addNodes(int nodeIdx, int currLen, node_t **nodes){
-	if(checkNodesExisting(nodeIdx, currLen, nodes) != 1){
-		(*nodes)[currLen].nodeIdx = nodeIdx;
-		(*nodes)[currLen].color = 0;
-		return 1;
-	}
-	return 0;
+static int compareNodes(const void *a, const void *b){
+	int first = *(const int *)a;
+	int second = *(const int *)b;
+	return (first > second) - (first < second);
 }
 
 /**
@@ -97,102 +114,641 @@ static void convertEdge(char *toConvert, edge_t *edge){
 	edge->second_node = strtol(strtok(NULL, "-"), NULL, 10);
 }
 
+/**
+ * @brief allocates memory and terminates if there is none
+ * 
+ * @param size 
+ * @return void* 
+ */
+static void *allocate(size_t size){
+	void *memory = malloc(size);
+	if(memory == NULL){
+		fprintf(stderr, "%s - Couldn't allocate memory: %s\n", PROGRAM_NAME, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return memory;
+}
+
+/**
+ * @brief allocates the colors of a graph
+ * 
+ * @param nodesCount 
+ * @return uint8_t* 
+ */
+static uint8_t *allocateColors(int nodesCount){
+	uint8_t *colors = allocate(nodesCount + COLOR_PADDING);
+	memset(colors, 0, nodesCount + COLOR_PADDING);
+	return colors;
+}
+
 /**
  * @brief parses the input, firstly a regex is created to check if the given edges are in the right format
- * then the edge is converted, then nodes are added if not already in nodes array
- * at the end we set the nodes count with is the length if the nodes array to the currLen which we count
- * through the process and set the edges count to argc-1
+ * then every edge is converted, then the ids of all nodes are sorted and every node gets the position of its id
+ * in the sorted ids without duplicates as its index, so the nodes of an edge are found by an index instead of a search,
+ * at the end the neighbors of every node are collected for the local searches, argv holds only the edges
  * 
  * @param argc 
  * @param argv 
- * @param nodes 
- * @param edges 
- * @param nodesCount 
- * @param edgesCount 
+ * @param graph 
  */
-static void parseInput(int argc, char **argv, node_t **nodes, edge_t **edges, int *nodesCount, int *edgesCount){
+static void parseInput(int argc, char **argv, graph_t *graph){
 	regex_t reg;
-	if(regcomp(&reg, "^[0-9]*-[0-9]*$", REG_EXTENDED | REG_NOSUB)) {
+	if(regcomp(&reg, "^[0-9]+-[0-9]+$", REG_EXTENDED | REG_NOSUB)) {
         fprintf(stderr, "ERROR: %s Couldn't create regex!\n",PROGRAM_NAME);
         exit(EXIT_FAILURE);
     }
-	int currLen = 0;
-	node_t **currNodes = malloc(sizeof(node_t)*argc*2);
-	for(int i = 1; i < argc; i++){
-		if(regexec(&reg, argv[i], 0, NULL, 0) == 0){
-			// edge
-			convertEdge(argv[i], &((*edges)[i - 1]));
-			edge_t edge = (*edges)[i - 1];
-			memcpy(currNodes, nodes, sizeof(node_t)*argc*2);
-			// nodes from edge
-			currLen += addNodes(edge.first_node, currLen, currNodes);
-			currLen += addNodes(edge.second_node, currLen, currNodes);
-		} else {
+	int edgesCount = argc;
+	graph->edgesCount = edgesCount;
+	graph->edges = allocate(sizeof(edge_t)*edgesCount);
+	graph->firstNodes = allocate(sizeof(int)*edgesCount);
+	graph->secondNodes = allocate(sizeof(int)*edgesCount);
+	int *ids = allocate(sizeof(int)*edgesCount*2);
+	for(int i = 0; i < edgesCount; i++){
+		if(regexec(&reg, argv[i], 0, NULL, 0) != 0){
 			wrongInputError();
 		}
+		convertEdge(argv[i], &graph->edges[i]);
+		ids[2*i] = graph->edges[i].first_node;
+		ids[2*i + 1] = graph->edges[i].second_node;
 	}
-	*nodesCount = currLen;
-	*edgesCount = argc-1;
 	regfree(&reg);
-	free(currNodes);
+
+	qsort(ids, edgesCount*2, sizeof(int), compareNodes);
+	int nodesCount = 0;
+	for(int i = 0; i < edgesCount*2; i++){
+		if(nodesCount == 0 || ids[nodesCount - 1] != ids[i]){
+			ids[nodesCount++] = ids[i];
+		}
+	}
+	for(int i = 0; i < edgesCount; i++){
+		graph->firstNodes[i] = (int *)bsearch(&graph->edges[i].first_node, ids, nodesCount, sizeof(int), compareNodes) - ids;
+		graph->secondNodes[i] = (int *)bsearch(&graph->edges[i].second_node, ids, nodesCount, sizeof(int), compareNodes) - ids;
+	}
+	free(ids);
+	graph->nodesCount = nodesCount;
+	graph->colors = allocateColors(nodesCount);
+
+	graph->selfLoops = 0;
+	graph->adjacencyStart = allocate(sizeof(int)*(nodesCount + 1));
+	memset(graph->adjacencyStart, 0, sizeof(int)*(nodesCount + 1));
+	for(int i = 0; i < edgesCount; i++){
+		if(graph->firstNodes[i] == graph->secondNodes[i]){
+			graph->selfLoops++;
+		}else{
+			graph->adjacencyStart[graph->firstNodes[i] + 1]++;
+			graph->adjacencyStart[graph->secondNodes[i] + 1]++;
+		}
+	}
+	for(int i = 0; i < nodesCount; i++){
+		graph->adjacencyStart[i + 1] += graph->adjacencyStart[i];
+	}
+	graph->adjacency = allocate(sizeof(int)*(graph->adjacencyStart[nodesCount] + 1));
+	int *next = allocate(sizeof(int)*nodesCount);
+	memcpy(next, graph->adjacencyStart, sizeof(int)*nodesCount);
+	for(int i = 0; i < edgesCount; i++){
+		if(graph->firstNodes[i] != graph->secondNodes[i]){
+			graph->adjacency[next[graph->firstNodes[i]]++] = graph->secondNodes[i];
+			graph->adjacency[next[graph->secondNodes[i]]++] = graph->firstNodes[i];
+		}
+	}
+	free(next);
+}
+
+/**
+ * @brief frees the memory of the graph
+ * 
+ * @param graph 
+ */
+static void freeGraph(graph_t *graph){
+	free(graph->edges);
+	free(graph->firstNodes);
+	free(graph->secondNodes);
+	free(graph->adjacencyStart);
+	free(graph->adjacency);
+	free(graph->colors);
 }
 
 /**
  * @brief sets the color for every node ranomly to exact one value of these numbers: 0,1,2 which each represents one color
  * 
- * @param nodesCount 
- * @param nodes 
+ * @param graph 
+ * @param search 
  */
-static void randomNodeColor(int nodesCount, node_t *nodes){
-	for(int i = 0; i < nodesCount; i++){
-		nodes[i].color = (rand() % 3);
-	}
+static void randomNodeColor(graph_t *graph, search_t *search){
+	randomColors(search->random, graph->colors, graph->nodesCount);
 }
 
 /**
- * @brief Get the Node object with the given nodeIdx if it exists
+ * @brief collects every edge from the edge first on between two nodes with the same color into the solution, it stops
+ * as soon as there are more than maxEdges edges to remove 1 if the solution has at most maxEdges edges 0 if not
  * 
- * @param nodeIdx 
- * @param currLen 
- * @param nodes 
- * @return node_t* 
+ * @param graph 
+ * @param first 
+ * @param maxEdges 
+ * @param solution 
+ * @return int 
  */
-static node_t* getNode(int nodeIdx, int currLen, node_t *nodes){
-	for(int i = 0; i < currLen; i++){
-		if(nodes[i].nodeIdx == nodeIdx){
-			return &nodes[i];
+static int collectEdges(graph_t *graph, int first, int maxEdges, solution_t *solution){
+	const uint8_t *colors = graph->colors;
+	const int *firstNodes = graph->firstNodes;
+	const int *secondNodes = graph->secondNodes;
+	for(int i = first; i < graph->edgesCount; i++){
+		if(colors[firstNodes[i]] == colors[secondNodes[i]]){
+			if(solution->numberOfEdges >= maxEdges){
+				return 0;
+			}
+			solution->edges[solution->numberOfEdges++] = graph->edges[i];
 		}
 	}
-	return NULL;
+	return 1;
 }
 
 /**
- * @brief finds a possible solution with has less the MAX_EDGES by removing every edge between two nodes with
- * the same color
+ * @brief collects every edge between two nodes with the same color into the solution one edge at a time
  * 
- * @param nodes 
- * @param edges 
- * @param nodesCount 
- * @param edgesCount 
+ * @param graph 
+ * @param maxEdges 
  * @param solution 
  * @return int 
  */
-static int findSolution(node_t *nodes, edge_t *edges, int nodesCount, int edgesCount, solution_t *solution){
-	randomNodeColor(nodesCount, nodes);
+static int collectSolutionScalar(graph_t *graph, int maxEdges, solution_t *solution){
+	solution->numberOfEdges = 0;
+	return collectEdges(graph, 0, maxEdges, solution);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief collects every edge between two nodes with the same color into the solution 32 edges at a time with AVX2,
+ * the colors of the nodes of 8 edges are gathered at once and compared, only the bits of the edges with the same
+ * colors are looked at one by one which are few once the solutions are good. The gather reads 4 bytes at every
+ * node that's why the colors have COLOR_PADDING bytes more
+ * 
+ * @param graph 
+ * @param maxEdges 
+ * @param solution 
+ * @return int 
+ */
+__attribute__((target("avx2")))
+static int collectSolutionAvx2(graph_t *graph, int maxEdges, solution_t *solution){
+	const int *colors = (const int *)graph->colors;
+	const int *firstNodes = graph->firstNodes;
+	const int *secondNodes = graph->secondNodes;
+	const __m256i colorMask = _mm256_set1_epi32(0xFF);
+	solution->numberOfEdges = 0;
 	int i = 0;
-	for(int countEdges = 0; i < edgesCount; i++){
-		node_t fn = *getNode(edges[i].first_node, nodesCount, nodes);
-		node_t sn = *getNode(edges[i].second_node, nodesCount, nodes);
- 		if(fn.color == sn.color){
-			if(solution->numberOfEdges == MAX_EDGES)
+	for(; i + 32 <= graph->edgesCount; i += 32){
+		uint32_t same = 0;
+		for(int block = 0; block < 4; block++){
+			__m256i first = _mm256_loadu_si256((const __m256i *)&firstNodes[i + block*8]);
+			__m256i second = _mm256_loadu_si256((const __m256i *)&secondNodes[i + block*8]);
+			__m256i firstColors = _mm256_and_si256(_mm256_i32gather_epi32(colors, first, 1), colorMask);
+			__m256i secondColors = _mm256_and_si256(_mm256_i32gather_epi32(colors, second, 1), colorMask);
+			__m256i equal = _mm256_cmpeq_epi32(firstColors, secondColors);
+			same |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(equal)) << (block*8);
+		}
+		while(same != 0){
+			int edge = i + __builtin_ctz(same);
+			same &= same - 1;
+			if(solution->numberOfEdges >= maxEdges){
+				return 0;
+			}
+			solution->edges[solution->numberOfEdges++] = graph->edges[edge];
+		}
+	}
+	return collectEdges(graph, i, maxEdges, solution);
+}
+#endif
+
+/**
+ * @brief collects every edge between two nodes with the same color into the solution, it stops as soon as there
+ * are more than maxEdges edges to remove 1 if the solution has at most maxEdges edges 0 if not,
+ * selectCollectSolution sets the fastest version the cpu supports
+ * 
+ */
+static int (*collectSolution)(graph_t *graph, int maxEdges, solution_t *solution) = collectSolutionScalar;
+
+/**
+ * @brief sets collectSolution to the fastest version the cpu supports, this has to happen before the threads start
+ * 
+ */
+static void selectCollectSolution(void){
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		collectSolution = collectSolutionAvx2;
+	}
+#endif
+}
+
+/**
+ * @brief random restart strategy, colors every node randomly and collects the edges to remove
+ * 
+ * @param graph 
+ * @param search 
+ * @param maxEdges 
+ * @param solution 
+ * @return int 
+ */
+static int randomRestart(graph_t *graph, search_t *search, int maxEdges, solution_t *solution){
+	randomNodeColor(graph, search);
+	return collectSolution(graph, maxEdges, solution);
+}
+
+/**
+ * @brief allocates the state of a local search
+ * 
+ * @param graph 
+ * @param search 
+ */
+static void initSearch(graph_t *graph, search_t *search){
+	search->neighborColors = allocate(sizeof(int)*graph->nodesCount*3);
+	search->conflictedNodes = allocate(sizeof(int)*graph->nodesCount);
+	search->conflictedPositions = allocate(sizeof(int)*graph->nodesCount);
+	search->tabu = allocate(sizeof(unsigned long)*graph->nodesCount*3);
+}
+
+/**
+ * @brief frees the state of a local search
+ * 
+ * @param search 
+ */
+static void freeSearch(search_t *search){
+	free(search->neighborColors);
+	free(search->conflictedNodes);
+	free(search->conflictedPositions);
+	free(search->tabu);
+}
+
+/**
+ * @brief adds the node to the conflicted nodes if it has a neighbor with the same color or removes it if not
+ * 
+ * @param graph 
+ * @param search 
+ * @param node 
+ */
+static void updateConflicted(graph_t *graph, search_t *search, int node){
+	int conflicted = search->neighborColors[node*3 + graph->colors[node]] > 0;
+	int position = search->conflictedPositions[node];
+	if(conflicted && position < 0){
+		search->conflictedPositions[node] = search->conflictedCount;
+		search->conflictedNodes[search->conflictedCount++] = node;
+	}else if(!conflicted && position >= 0){
+		// the last node takes the place of the removed one
+		int last = search->conflictedNodes[--search->conflictedCount];
+		search->conflictedNodes[position] = last;
+		search->conflictedPositions[last] = position;
+		search->conflictedPositions[node] = -1;
+	}
+}
+
+/**
+ * @brief colors every node randomly and counts the colors of the neighbors and the conflicts from scratch
+ * 
+ * @param graph 
+ * @param search 
+ */
+static void restartSearch(graph_t *graph, search_t *search){
+	randomNodeColor(graph, search);
+	memset(search->neighborColors, 0, sizeof(int)*graph->nodesCount*3);
+	memset(search->tabu, 0, sizeof(unsigned long)*graph->nodesCount*3);
+	int conflicts = 0;
+	for(int node = 0; node < graph->nodesCount; node++){
+		for(int i = graph->adjacencyStart[node]; i < graph->adjacencyStart[node + 1]; i++){
+			search->neighborColors[node*3 + graph->colors[graph->adjacency[i]]]++;
+		}
+		conflicts += search->neighborColors[node*3 + graph->colors[node]];
+	}
+	search->conflictedCount = 0;
+	for(int node = 0; node < graph->nodesCount; node++){
+		search->conflictedPositions[node] = -1;
+		updateConflicted(graph, search, node);
+	}
+	// every conflict was counted from both nodes
+	search->conflicts = conflicts / 2;
+	search->bestConflicts = search->conflicts;
+	search->stale = 0;
+	search->iteration = 0;
+}
+
+/**
+ * @brief gives the node a new color and updates the colors of the neighbors of its neighbors and the conflicts,
+ * only the neighbors of the node are touched
+ * 
+ * @param graph 
+ * @param search 
+ * @param node 
+ * @param color 
+ */
+static void moveNode(graph_t *graph, search_t *search, int node, int color){
+	int oldColor = graph->colors[node];
+	search->conflicts += search->neighborColors[node*3 + color] - search->neighborColors[node*3 + oldColor];
+	graph->colors[node] = color;
+	for(int i = graph->adjacencyStart[node]; i < graph->adjacencyStart[node + 1]; i++){
+		int neighbor = graph->adjacency[i];
+		search->neighborColors[neighbor*3 + oldColor]--;
+		search->neighborColors[neighbor*3 + color]++;
+		updateConflicted(graph, search, neighbor);
+	}
+	updateConflicted(graph, search, node);
+}
+
+/**
+ * @brief one min-conflicts step, a random conflicted node takes the color with the fewest conflicts,
+ * ties are broken randomly and every tenth step the node takes a random color to get out of local minima
+ * 
+ * @param graph 
+ * @param search 
+ */
+static void minConflictsStep(graph_t *graph, search_t *search){
+	int node = search->conflictedNodes[nextRandom(search->random) % search->conflictedCount];
+	const int *neighborColors = &search->neighborColors[node*3];
+	int color = graph->colors[node];
+	if(nextRandom(search->random) % 10 == 0){
+		color = (color + 1 + nextRandom(search->random) % 2) % 3;
+	}else{
+		int ties = 0;
+		for(int c = 0; c < 3; c++){
+			if(c == graph->colors[node]){
+				continue;
+			}
+			if(neighborColors[c] < neighborColors[color]){
+				color = c;
+				ties = 1;
+			}else if(neighborColors[c] == neighborColors[color] && nextRandom(search->random) % ++ties == 0){
+				color = c;
+			}
+		}
+	}
+	if(color != graph->colors[node]){
+		moveNode(graph, search, node, color);
+	}
+}
+
+/**
+ * @brief one tabu search step, of all color changes of conflicted nodes the one with the fewest conflicts is made
+ * even if that's more than now, a node mustn't take its old color again for some iterations unless that
+ * leads to fewer conflicts than ever since the last restart
+ * 
+ * @param graph 
+ * @param search 
+ */
+static void tabuStep(graph_t *graph, search_t *search){
+	int bestNode = -1;
+	int bestColor = 0;
+	int bestDelta = 0;
+	int ties = 0;
+	for(int i = 0; i < search->conflictedCount; i++){
+		int node = search->conflictedNodes[i];
+		const int *neighborColors = &search->neighborColors[node*3];
+		int current = graph->colors[node];
+		for(int color = 0; color < 3; color++){
+			if(color == current){
+				continue;
+			}
+			int delta = neighborColors[color] - neighborColors[current];
+			if(search->tabu[node*3 + color] > search->iteration && search->conflicts + delta >= search->bestConflicts){
+				continue;
+			}
+			if(bestNode < 0 || delta < bestDelta){
+				bestNode = node;
+				bestColor = color;
+				bestDelta = delta;
+				ties = 1;
+			}else if(delta == bestDelta && nextRandom(search->random) % ++ties == 0){
+				bestNode = node;
+				bestColor = color;
+			}
+		}
+	}
+	if(bestNode < 0){
+		// every move is tabu
+		bestNode = search->conflictedNodes[nextRandom(search->random) % search->conflictedCount];
+		bestColor = (graph->colors[bestNode] + 1 + nextRandom(search->random) % 2) % 3;
+	}
+	search->tabu[bestNode*3 + graph->colors[bestNode]] = search->iteration + nextRandom(search->random) % 10 + search->conflictedCount * 6 / 10;
+	moveNode(graph, search, bestNode, bestColor);
+}
+
+/**
+ * @brief runs up to SEARCH_STEPS steps of a local search from the colors of the last call 1 if the colors have
+ * at most maxEdges edges to remove then, the search starts with new random colors if it didn't get better for
+ * SEARCH_RESTART steps
+ * 
+ * @param graph 
+ * @param search 
+ * @param maxEdges 
+ * @param solution 
+ * @param step 
+ * @return int 
+ */
+static int localSearch(graph_t *graph, search_t *search, int maxEdges, solution_t *solution, void (*step)(graph_t *, search_t *)){
+	for(int i = 0; i < SEARCH_STEPS; i++){
+		if(search->conflicts + graph->selfLoops <= maxEdges){
+			return collectSolution(graph, maxEdges, solution);
+		}
+		if(search->conflictedCount == 0){
+			// only self loops are left, no color can remove them
+			return 0;
+		}
+		step(graph, search);
+		search->iteration++;
+		if(search->conflicts < search->bestConflicts){
+			search->bestConflicts = search->conflicts;
+			search->stale = 0;
+		}else if(++search->stale > SEARCH_RESTART){
+			restartSearch(graph, search);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief min-conflicts strategy
+ * 
+ * @param graph 
+ * @param search 
+ * @param maxEdges 
+ * @param solution 
+ * @return int 
+ */
+static int minConflicts(graph_t *graph, search_t *search, int maxEdges, solution_t *solution){
+	return localSearch(graph, search, maxEdges, solution, minConflictsStep);
+}
+
+/**
+ * @brief tabu search strategy
+ * 
+ * @param graph 
+ * @param search 
+ * @param maxEdges 
+ * @param solution 
+ * @return int 
+ */
+static int tabuSearch(graph_t *graph, search_t *search, int maxEdges, solution_t *solution){
+	return localSearch(graph, search, maxEdges, solution, tabuStep);
+}
+
+/**
+ * @brief A search strategy, findSolution tries to find a solution with at most maxEdges edges 1 if it did 0 if not,
+ * local searches continue from where the last call stopped
+ * 
+ */
+typedef struct strategy{
+	const char *name;
+	int (*findSolution)(graph_t *graph, search_t *search, int maxEdges, solution_t *solution);
+} strategy_t;
+
+static const strategy_t strategies[] = {
+	{ "random", randomRestart },
+	{ "minconflicts", minConflicts },
+	{ "tabu", tabuSearch },
+};
+
+/**
+ * @brief parses the options, the first argument which is no option is the first edge
+ * 
+ * @param argc 
+ * @param argv 
+ * @param threads is set to the number of search threads
+ * @param seed is set to the given seed and left as it is if there is none
+ * @return const strategy_t* 
+ */
+static const strategy_t *parseOptions(int argc, char **argv, int *threads, uint64_t *seed){
+	const strategy_t *strategy = &strategies[0];
+	*threads = 1;
+	int option;
+	char *end;
+	while((option = getopt(argc, argv, "a:j:s:")) != -1){
+		switch(option){
+			case 'a':
+				strategy = NULL;
+				for(size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++){
+					if(strcmp(optarg, strategies[i].name) == 0){
+						strategy = &strategies[i];
+					}
+				}
+				if(strategy == NULL){
+					fprintf(stderr, "%s Error: Unknown search strategy %s.\n", PROGRAM_NAME, optarg);
+					wrongInputError();
+				}
 				break;
-			solution->edges[countEdges] = edges[i];
-			solution->numberOfEdges++;
-			countEdges++;
+			case 'j':{
+				long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+				long maxThreads = THREADS_PER_CPU * (cpus > 0 ? cpus : 1);
+				errno = 0;
+				long number = strtol(optarg, &end, 10);
+				if(*end != '\0' || *optarg == '\0' || errno != 0 || number < 1 || number > maxThreads){
+					fprintf(stderr, "%s Error: The number of threads has to be between 1 and %ld.\n", PROGRAM_NAME, maxThreads);
+					wrongInputError();
+				}
+				*threads = number;
+				break;
+			}
+			case 's':
+				errno = 0;
+				*seed = strtoull(optarg, &end, 10);
+				if(*end != '\0' || *optarg < '0' || *optarg > '9' || errno != 0){
+					fprintf(stderr, "%s Error: The seed has to be a non-negative integer.\n", PROGRAM_NAME);
+					wrongInputError();
+				}
+				break;
+			default:
+				wrongInputError();
 		}
-		if(countEdges == edgesCount) return 0;
 	}
-	return i == edgesCount ? 1 : 0; 
+	if(optind >= argc){
+		fprintf(stderr, "%s Error: No edges given.\n", PROGRAM_NAME);
+		wrongInputError();
+	}
+	return strategy;
+}
+
+/**
+ * @brief One search thread, it shares the edges of the graph with all threads but has its own colors and search,
+ * edges has room for the edges of its solutions
+ * 
+ */
+typedef struct worker{
+	pthread_t thread;
+	graph_t graph;
+	search_t search;
+	const strategy_t *strategy;
+	edge_t *edges;
+} worker_t;
+
+/**
+ * @brief hands a solution to the main thread if it is better than every solution of this generator so far
+ * 
+ * @param solution 
+ */
+static void offerSolution(const solution_t *solution){
+	pthread_mutex_lock(&publishMutex);
+	if(solution->numberOfEdges < processBest){
+		memcpy(pendingSolution.edges, solution->edges, sizeof(edge_t) * solution->numberOfEdges);
+		pendingSolution.numberOfEdges = solution->numberOfEdges;
+		hasPendingSolution = 1;
+		__atomic_store_n(&processBest, solution->numberOfEdges, __ATOMIC_RELAXED);
+		pthread_cond_signal(&publishCond);
+	}
+	pthread_mutex_unlock(&publishMutex);
+}
+
+/**
+ * @brief searches until everything should be terminated, only solutions which are better than the best solution of
+ * the supervisor and of this generator are handed to the main thread
+ * 
+ * @param arg the worker
+ * @return void* 
+ */
+static void *searchSolutions(void *arg){
+	worker_t *worker = arg;
+	restartSearch(&worker->graph, &worker->search);
+	while(solution_buffer->quit == 0 && quit == 0){
+		int bound = __atomic_load_n(&solution_buffer->bestEdges, __ATOMIC_RELAXED);
+		int ownBest = __atomic_load_n(&processBest, __ATOMIC_RELAXED);
+		if(ownBest < bound){
+			bound = ownBest;
+		}
+		solution_t solution = {.edges = worker->edges, .numberOfEdges = 0};
+		if(worker->strategy->findSolution(&worker->graph, &worker->search, bound - 1, &solution) == 1){
+			offerSolution(&solution);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief writes the solutions of the threads until everything should be terminated, it wakes up regularly
+ * to notice the termination
+ * 
+ */
+static void publishSolutions(void){
+	solution_t solution = {.edges = allocate(sizeof(edge_t) * maxEdges), .numberOfEdges = 0};
+	while(solution_buffer->quit == 0 && quit == 0){
+		int found = 0;
+		pthread_mutex_lock(&publishMutex);
+		if(hasPendingSolution == 0){
+			struct timespec timeout;
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			timeout.tv_nsec += 100000000;
+			if(timeout.tv_nsec >= 1000000000){
+				timeout.tv_sec++;
+				timeout.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&publishCond, &publishMutex, &timeout);
+		}
+		if(hasPendingSolution == 1){
+			memcpy(solution.edges, pendingSolution.edges, sizeof(edge_t) * pendingSolution.numberOfEdges);
+			solution.numberOfEdges = pendingSolution.numberOfEdges;
+			hasPendingSolution = 0;
+			found = 1;
+		}
+		pthread_mutex_unlock(&publishMutex);
+		if(found == 1){
+			writeSolution(solution_buffer, &solution, freeSem, usedSem, &quit, PROGRAM_NAME);
+		}
+	}
+	free(solution.edges);
 }
 
 /**
@@ -201,8 +757,8 @@ static int findSolution(node_t *nodes, edge_t *edges, int nodesCount, int edgesC
  */
 static void closeUp(void){
 	if(solution_buffer != NULL){
-		solution_buffer->shmTracker--;
-        unmapSHM(solution_buffer, sizeof(*solution_buffer), PROGRAM_NAME);
+		__atomic_sub_fetch(&solution_buffer->shmTracker, 1, __ATOMIC_SEQ_CST);
+        unmapSHM(solution_buffer, shmSize, PROGRAM_NAME);
     }
     if(freeSem != NULL){
         closeSem(freeSem, PROGRAM_NAME);
@@ -210,34 +766,17 @@ static void closeUp(void){
     if(usedSem != NULL){
         closeSem(usedSem, PROGRAM_NAME);
     }
-    if(writeSem != NULL){
-        closeSem(writeSem, PROGRAM_NAME);
-    }
-}
-
-/**
- * @brief writes the solution to the shared memory
- * 
- * @param solution 
- */
-static void writeToSolutionBuffer(solution_t solution){
-	waitSem(writeSem, PROGRAM_NAME);
-	waitSem(freeSem, PROGRAM_NAME);
-
- 	solution_buffer->solutions[solution_buffer->write] = solution;
-	solution_buffer->write = (solution_buffer->write+1) % MAX_EDGES;
-
-	postSem(usedSem, PROGRAM_NAME);
-	postSem(writeSem, PROGRAM_NAME);
 }
 
 /**
  * @brief this is the main method which manages the whole program process first we introduce the atexit function
  * which helps us to closeup everything either when closed successfully or not. Next we check if the input is right and
- * introduce the signal handler, then we parse our input, then we open our sharedmemory and check if we already found a 
- * perfect solution only needed when parallel generators are running we open our 3 semaphores, then set the solution_buffer 
- * tracker to +1 so we can know how many generators are running, then we introduce random seeds, then we search for a perfect 
- * solution until one generator finds one
+ * introduce the signal handler, then we parse the search strategy and our input, then we open our sharedmemory and check if we already found a 
+ * perfect solution only needed when parallel generators are running, the size of the ring and the maximum edges of a solution
+ * are read from the sharedmemory, then we open our 2 semaphores, then set the solution_buffer 
+ * tracker to +1 so we can know how many generators are running, then we start the search threads which each have their own
+ * colors and random seed and search for a perfect solution with the chosen strategy until one generator finds one,
+ * the main thread writes every solution which is better than the best solution of the supervisor
  * 
  * 
  * @param argc 
@@ -249,40 +788,82 @@ int main(int argc, char **argv) {
         fprintf(stderr, "%s - Couldn't set up closeup function: %s\n", PROGRAM_NAME, strerror(errno));
         exit(EXIT_FAILURE);
     }
-	if(argc <= 1){
-		fprintf(stderr, "%s Error: No edges given.\n", PROGRAM_NAME);
-		wrongInputError();
-	}
+	int threads;
+	uint64_t seed = (uint64_t)time(NULL) * getpid();
+	const strategy_t *strategy = parseOptions(argc, argv, &threads, &seed);
 
 	listenToSignal();
+	selectCollectSolution();
 
-	node_t *nodes = malloc(sizeof(node_t)*argc*2);
-	edge_t *edges = malloc(sizeof(edge_t)*argc);
-	int nodesCount;
-	int edgesCount; 
-
-	parseInput(argc, argv, &nodes, &edges, &nodesCount, &edgesCount);
+	graph_t graph;
+	parseInput(argc - optind, argv + optind, &graph);
 
     shmfd = openSHM(PROGRAM_NAME);
-    solution_buffer = mapSHM(shmfd, sizeof(*solution_buffer), PROGRAM_NAME);
+	// the supervisor sized the shared memory for its ring
+	struct stat shmStat;
+	if(fstat(shmfd, &shmStat) == -1){
+		fprintf(stderr, "%s - Couldn't get the size of the shared memory object: %s\n", PROGRAM_NAME, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	if((size_t)shmStat.st_size < sizeof(shm_t)){
+		fprintf(stderr, "%s Error: The supervisor isn't running.\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	shmSize = shmStat.st_size;
+    solution_buffer = mapSHM(shmfd, shmSize, PROGRAM_NAME);
     shmfd = -1;
 	if(solution_buffer->quit == 1) exit(EXIT_SUCCESS);
+	if(solution_buffer->capacity < 1 || ringSize(solution_buffer->capacity) > shmSize || solution_buffer->maxEdges < 1 ||
+		solution_buffer->maxEdges > MAX_EDGES_LIMIT){
+		fprintf(stderr, "%s Error: The supervisor isn't ready.\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	maxEdges = solution_buffer->maxEdges;
+	processBest = maxEdges+1;
 	openSem(&freeSem, SEM_FREE, 0, 1, PROGRAM_NAME);
 	openSem(&usedSem ,SEM_USED, 0, 1, PROGRAM_NAME);
-	openSem(&writeSem, SEM_WRITE_BLOCK, 0, 1, PROGRAM_NAME);
 
-	solution_buffer->shmTracker++;
+	__atomic_add_fetch(&solution_buffer->shmTracker, 1, __ATOMIC_SEQ_CST);
 
-	srand(time(NULL)*getpid());
-
-	while(solution_buffer->quit == 0 && quit == 0){
-		solution_t solution = {.numberOfEdges = 0};
-		if(findSolution(nodes, edges, nodesCount, edgesCount, &solution) == 1){
-			writeToSolutionBuffer(solution);
+	pendingSolution.edges = allocate(sizeof(edge_t) * maxEdges);
+	// the threads inherit the blocked signals, so a signal always interrupts the main thread which may sleep in writeSolution
+	sigset_t signals, previousSignals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &previousSignals);
+	worker_t *workers = allocate(sizeof(worker_t)*threads);
+	for(int i = 0; i < threads; i++){
+		workers[i].graph = graph;
+		workers[i].graph.colors = allocateColors(graph.nodesCount);
+		workers[i].strategy = strategy;
+		workers[i].edges = allocate(sizeof(edge_t) * maxEdges);
+		initSearch(&workers[i].graph, &workers[i].search);
+		// every thread continues 2^128 numbers after the one before, so a seed gives the same numbers in every run
+		if(i == 0){
+			seedRandom(workers[i].search.random, seed);
+		}else{
+			memcpy(workers[i].search.random, workers[i - 1].search.random, sizeof(workers[i].search.random));
+			jumpRandom(workers[i].search.random);
+		}
+		int error = pthread_create(&workers[i].thread, NULL, searchSolutions, &workers[i]);
+		if(error != 0){
+			fprintf(stderr, "%s - Couldn't create thread: %s\n", PROGRAM_NAME, strerror(error));
+			exit(EXIT_FAILURE);
 		}
 	}
+	pthread_sigmask(SIG_SETMASK, &previousSignals, NULL);
+
+	publishSolutions();
 
-	free(edges);
-	free(nodes);
+	for(int i = 0; i < threads; i++){
+		pthread_join(workers[i].thread, NULL);
+		freeSearch(&workers[i].search);
+		free(workers[i].graph.colors);
+		free(workers[i].edges);
+	}
+	free(workers);
+	free(pendingSolution.edges);
+	freeGraph(&graph);
 	exit(EXIT_SUCCESS);
 }
\ No newline at end of file
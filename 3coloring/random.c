@@ -0,0 +1,141 @@
+/**
+ * @file random.c
+ * @author
+ * @brief Defines the xoshiro256** random number generator. Every search thread has its own state, so drawing numbers
+ * needs no lock like rand() does, and colors are drawn in bulk with up to 32 colors of 2 bits from one number
+ * @version 0.1
+ * @date 12.11.2022
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/**
+ * @brief For every byte of a random number the colors of its four 2 bit values without the value 3, packed into
+ * the bytes of an int, and how many of them there are
+ *
+ */
+static uint32_t colorTable[256];
+static uint8_t colorTableCounts[256];
+static pthread_once_t colorTableOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief rotates the bits of x by k to the left
+ *
+ * @param x
+ * @param k
+ * @return uint64_t
+ */
+static inline uint64_t rotateLeft(uint64_t x, int k){
+	return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief seeds the state with splitmix64, so close seeds like the ones of consecutive runs give unrelated states
+ *
+ * @param state
+ * @param seed
+ */
+void seedRandom(uint64_t state[4], uint64_t seed){
+	for(int i = 0; i < 4; i++){
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		state[i] = z ^ (z >> 31);
+	}
+}
+
+/**
+ * @brief returns the next random number
+ *
+ * @param state
+ * @return uint64_t
+ */
+uint64_t nextRandom(uint64_t state[4]){
+	uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+	uint64_t t = state[1] << 17;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = rotateLeft(state[3], 45);
+	return result;
+}
+
+/**
+ * @brief advances the state by 2^128 numbers, states which are jumped from each other never give the same numbers
+ * so every thread can get its own part of one seed
+ *
+ * @param state
+ */
+void jumpRandom(uint64_t state[4]){
+	static const uint64_t jump[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+	uint64_t jumped[4] = { 0, 0, 0, 0 };
+	for(int i = 0; i < 4; i++){
+		for(int bit = 0; bit < 64; bit++){
+			if(jump[i] & (1ULL << bit)){
+				for(int j = 0; j < 4; j++){
+					jumped[j] ^= state[j];
+				}
+			}
+			nextRandom(state);
+		}
+	}
+	memcpy(state, jumped, sizeof(jumped));
+}
+
+/**
+ * @brief builds the color table
+ *
+ */
+static void buildColorTable(void){
+	for(int byte = 0; byte < 256; byte++){
+		uint8_t colors[4] = { 0, 0, 0, 0 };
+		int count = 0;
+		for(int i = 0; i < 4; i++){
+			int value = (byte >> (2*i)) & 3;
+			if(value != 3){
+				colors[count++] = value;
+			}
+		}
+		memcpy(&colorTable[byte], colors, sizeof(colors));
+		colorTableCounts[byte] = count;
+	}
+}
+
+/**
+ * @brief fills colors with count random colors 0, 1 or 2, every number gives 32 values of 2 bits and the value 3
+ * is skipped so every color is equally likely. The colors of one byte are looked up and always stored as 4 bytes,
+ * only as many as there were values other than 3 are kept, so there is no branch on the random values
+ *
+ * @param state
+ * @param colors
+ * @param count
+ */
+void randomColors(uint64_t state[4], uint8_t *colors, int count){
+	pthread_once(&colorTableOnce, buildColorTable);
+	int i = 0;
+	while(i + 4 <= count){
+		uint64_t bits = nextRandom(state);
+		for(int j = 0; j < 8 && i + 4 <= count; j++){
+			uint8_t byte = bits;
+			bits >>= 8;
+			memcpy(&colors[i], &colorTable[byte], sizeof(uint32_t));
+			i += colorTableCounts[byte];
+		}
+	}
+	// the last colors don't fill 4 bytes
+	while(i < count){
+		uint64_t bits = nextRandom(state);
+		for(int j = 0; j < 32 && i < count; j++){
+			uint8_t color = bits & 3;
+			bits >>= 2;
+			colors[i] = color;
+			i += color != 3;
+		}
+	}
+}
@@ -0,0 +1,212 @@
+/**
+ * @file ringbuffer.c
+ * @author
+ * @brief Defines the lock-free solution ring in the shared memory. Every slot carries a sequence number which tells
+ * if it is free to be written at a position or holds the solution of a position, so generators only race for the
+ * write position with one compare and swap per solution and never wait for each other. A solution takes as many
+ * slots as its edges need. The semaphores are only used to sleep when the ring is empty or full
+ * @version 0.1
+ * @date 12.11.2022
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+/**
+ * @brief returns the number of slots a solution with the given number of edges takes
+ *
+ * @param numberOfEdges
+ * @return int
+ */
+int slotsForEdges(int numberOfEdges){
+	return numberOfEdges <= SLOT_EDGES ? 1 : (numberOfEdges + SLOT_EDGES - 1) / SLOT_EDGES;
+}
+
+/**
+ * @brief returns the size of the shared memory with the given number of slots
+ *
+ * @param capacity
+ * @return size_t
+ */
+size_t ringSize(int capacity){
+	return sizeof(shm_t) + sizeof(slot_t) * capacity;
+}
+
+/**
+ * @brief Initializes the ring, slot i is free to be written at position i
+ *
+ * @param shm
+ * @param capacity number of slots
+ * @param maxEdges maximum edges of a solution
+ */
+void initRing(shm_t *shm, int capacity, int maxEdges){
+	shm->capacity = capacity;
+	shm->maxEdges = maxEdges;
+	for(int i = 0; i < capacity; i++){
+		shm->solutions[i].sequence = i;
+	}
+	shm->writePos = 0;
+	shm->readPos = 0;
+	shm->supervisorSleeping = 0;
+	shm->generatorsSleeping = 0;
+}
+
+/**
+ * @brief Writes the solution into the next free slots 1 if successfull 0 if there aren't enough free slots
+ *
+ * @param shm
+ * @param solution
+ * @return int
+ */
+static int tryWriteSolution(shm_t *shm, const solution_t *solution){
+	unsigned long capacity = shm->capacity;
+	int slots = slotsForEdges(solution->numberOfEdges);
+	unsigned long pos = __atomic_load_n(&shm->writePos, __ATOMIC_RELAXED);
+	while(1){
+		long diff = (long)(__atomic_load_n(&shm->solutions[pos % capacity].sequence, __ATOMIC_ACQUIRE) - pos);
+		if(diff < 0){
+			// the slot still holds the solution of the previous round
+			return 0;
+		}
+		if(diff > 0){
+			pos = __atomic_load_n(&shm->writePos, __ATOMIC_RELAXED);
+			continue;
+		}
+		// the supervisor frees slots in order, so if the last slot is free all slots before it are too
+		unsigned long last = pos + slots - 1;
+		if(__atomic_load_n(&shm->solutions[last % capacity].sequence, __ATOMIC_ACQUIRE) != last){
+			return 0;
+		}
+		// claim the positions unless another generator was faster
+		if(__atomic_compare_exchange_n(&shm->writePos, &pos, pos + slots, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			break;
+		}
+	}
+	// the first slot is published last, so once the supervisor sees it all slots of the solution are written
+	for(int i = slots - 1; i >= 0; i--){
+		slot_t *slot = &shm->solutions[(pos + i) % capacity];
+		int edges = solution->numberOfEdges - i*SLOT_EDGES;
+		if(edges > SLOT_EDGES){
+			edges = SLOT_EDGES;
+		}
+		if(edges > 0){
+			memcpy(slot->edges, &solution->edges[i*SLOT_EDGES], sizeof(edge_t) * edges);
+		}
+		slot->numberOfEdges = solution->numberOfEdges;
+		__atomic_store_n(&slot->sequence, pos + i + 1, __ATOMIC_RELEASE);
+	}
+	return 1;
+}
+
+/**
+ * @brief Reads the written solutions and frees their slots, at most one round of the ring so generators can't keep
+ * the supervisor busy, the one with the fewest edges is copied to best if it has fewer edges than best
+ * returns the number of read solutions which is 0 if the ring is empty, there is only one reader
+ *
+ * @param shm
+ * @param best
+ * @return int
+ */
+static int tryReadSolutions(shm_t *shm, solution_t *best){
+	unsigned long capacity = shm->capacity;
+	unsigned long pos = shm->readPos;
+	unsigned long end = pos + capacity;
+	int count = 0;
+	while(pos < end){
+		slot_t *first = &shm->solutions[pos % capacity];
+		if(__atomic_load_n(&first->sequence, __ATOMIC_ACQUIRE) != pos + 1){
+			break;
+		}
+		int numberOfEdges = first->numberOfEdges;
+		int slots = slotsForEdges(numberOfEdges);
+		for(int i = 0; i < slots; i++){
+			slot_t *slot = &shm->solutions[(pos + i) % capacity];
+			if(numberOfEdges < best->numberOfEdges){
+				int edges = numberOfEdges - i*SLOT_EDGES;
+				if(edges > SLOT_EDGES){
+					edges = SLOT_EDGES;
+				}
+				if(edges > 0){
+					memcpy(&best->edges[i*SLOT_EDGES], slot->edges, sizeof(edge_t) * edges);
+				}
+			}
+			__atomic_store_n(&slot->sequence, pos + i + capacity, __ATOMIC_RELEASE);
+		}
+		if(numberOfEdges < best->numberOfEdges){
+			best->numberOfEdges = numberOfEdges;
+		}
+		pos += slots;
+		count++;
+	}
+	shm->readPos = pos;
+	return count;
+}
+
+/**
+ * @brief Writes the solution and wakes up the supervisor if it sleeps, if the ring is full the generator sleeps
+ * until the supervisor freed slots or everything or only this generator should be terminated
+ *
+ * @param shm
+ * @param solution
+ * @param freeSem
+ * @param usedSem
+ * @param stop is set when only this generator should be terminated
+ * @param programName
+ */
+void writeSolution(shm_t *shm, const solution_t *solution, sem_t *freeSem, sem_t *usedSem, volatile sig_atomic_t *stop,
+		const char *programName){
+	while(shm->quit == 0 && *stop == 0){
+		if(tryWriteSolution(shm, solution) == 0){
+			// announce the sleep before checking again, so the supervisor either sees it or the free slots are seen here
+			__atomic_add_fetch(&shm->generatorsSleeping, 1, __ATOMIC_SEQ_CST);
+			int written = tryWriteSolution(shm, solution);
+			if(written == 0 && shm->quit == 0 && *stop == 0){
+				waitSem(freeSem, programName);
+			}
+			__atomic_sub_fetch(&shm->generatorsSleeping, 1, __ATOMIC_SEQ_CST);
+			if(written == 0){
+				continue;
+			}
+		}
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(__atomic_exchange_n(&shm->supervisorSleeping, 0, __ATOMIC_SEQ_CST) == 1){
+			postSem(usedSem, programName);
+		}
+		return;
+	}
+}
+
+/**
+ * @brief Reads the written solutions and wakes up sleeping generators, if the ring is empty the supervisor
+ * sleeps until solutions are written, the one with the fewest edges is copied to best if it has fewer edges than best
+ * returns the number of read solutions which is 0 if it woke up without one
+ *
+ * @param shm
+ * @param best
+ * @param freeSem
+ * @param usedSem
+ * @param programName
+ * @return int
+ */
+int readSolutions(shm_t *shm, solution_t *best, sem_t *freeSem, sem_t *usedSem, const char *programName){
+	int found = tryReadSolutions(shm, best);
+	if(found == 0){
+		// announce the sleep before checking again, so a generator either sees it or its solutions are seen here
+		__atomic_store_n(&shm->supervisorSleeping, 1, __ATOMIC_SEQ_CST);
+		found = tryReadSolutions(shm, best);
+		if(found == 0 && shm->quit == 0){
+			waitSem(usedSem, programName);
+		}
+		__atomic_store_n(&shm->supervisorSleeping, 0, __ATOMIC_SEQ_CST);
+		if(found == 0){
+			return 0;
+		}
+	}
+	// slots were freed, so every sleeping generator can try to write again
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	int sleeping = __atomic_load_n(&shm->generatorsSleeping, __ATOMIC_SEQ_CST);
+	for(int i = 0; i < sleeping; i++){
+		postSem(freeSem, programName);
+	}
+	return found;
+}
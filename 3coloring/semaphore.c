@@ -19,7 +19,6 @@
 
 #define SEM_FREE "/sem_free"
 #define SEM_USED "/sem_used"
-#define SEM_WRITE_BLOCK "/sem_write"
 
 /**
  * @brief Opens a semaphore and handles upcoming errors if type 0 its for the supervisor if type 1 its for the generator
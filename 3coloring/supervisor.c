@@ -8,17 +8,19 @@
  * @copyright Copyright (c) 2022
  * valgrind --tool=memcheck --leak-check=yes ./supervisor to check for memory leaks
  */
+#include <time.h>
 #include "3color.h"
 #include "semaphore.c"
 #include "sharedmemory.c"
+#include "ringbuffer.c"
 
 #define PROGRAM_NAME "./supervisor"
 
 static int shmfd = -1;
 static shm_t *solution_buffer = NULL;
+static size_t shmSize = 0;
 static sem_t *freeSem = NULL;
 static sem_t *usedSem = NULL;
-static sem_t *writeSem = NULL; 
 
 /**
  * @brief Handles the signal when detected and sets quit to 1 so supervisor terminates
@@ -54,7 +56,7 @@ static void printSolution(solution_t solution){
 
 /**
  * @brief Checks if the given solution is better than the current best solution it sets the 
- * best solution to the given solution and prints it, if the solution has 0 edges removed its 
+ * best solution to the given solution, publishes its number of edges to the generators and prints it, if the solution has 0 edges removed its 
  * a 3 colorable graph or if the bestsolution is still the best it does nothing
  * anyway the readposition is moved up by one unless its the best solution
  * 
@@ -70,13 +72,75 @@ static int overwriteSolutionIfBetter(solution_t solution, solution_t *bestSoluti
 	}
 	if(bestSolution->numberOfEdges > solution.numberOfEdges){
 		printSolution(solution);
-		memcpy(bestSolution->edges, solution.edges, sizeof(((solution_t *)0)->edges));
+		memcpy(bestSolution->edges, solution.edges, sizeof(edge_t) * solution.numberOfEdges);
 		bestSolution->numberOfEdges = solution.numberOfEdges;
+		__atomic_store_n(&solution_buffer->bestEdges, solution.numberOfEdges, __ATOMIC_RELAXED);
 		return 1;
 	}
 	return -1;
 }
 
+/**
+ * @brief Function which is called when the input is wrong
+ * 
+ */
+static void wrongInputError(void){
+	fprintf(stderr, "Use: %s [-c capacity] [-e maxedges] where capacity is the number of slots of the solution ring "
+		"and maxedges the maximum edges of a solution, a solution takes one slot per %d edges.\n", PROGRAM_NAME, SLOT_EDGES);
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief parses a positive number of an option which is at most maximum
+ * 
+ * @param value 
+ * @param maximum 
+ * @return int 
+ */
+static int parsePositive(const char *value, int maximum){
+	char *end;
+	errno = 0;
+	long number = strtol(value, &end, 10);
+	if(*end != '\0' || *value == '\0' || errno != 0 || number < 1 || number > maximum){
+		wrongInputError();
+	}
+	return number;
+}
+
+/**
+ * @brief parses the options, the ring needs room for at least one solution with the maximum edges
+ * 
+ * @param argc 
+ * @param argv 
+ * @param capacity 
+ * @param maxEdges 
+ */
+static void parseOptions(int argc, char **argv, int *capacity, int *maxEdges){
+	*capacity = MAX_DATA;
+	*maxEdges = MAX_EDGES;
+	int option;
+	while((option = getopt(argc, argv, "c:e:")) != -1){
+		switch(option){
+			case 'c':
+				*capacity = parsePositive(optarg, INT32_MAX);
+				break;
+			case 'e':
+				*maxEdges = parsePositive(optarg, MAX_EDGES_LIMIT);
+				break;
+			default:
+				wrongInputError();
+		}
+	}
+	if(optind < argc){
+		fprintf(stderr, "%s: Arguments are not supported!\n", PROGRAM_NAME);
+		wrongInputError();
+	}
+	if(*capacity < slotsForEdges(*maxEdges)){
+		fprintf(stderr, "%s: A solution with %d edges needs %d slots.\n", PROGRAM_NAME, *maxEdges, slotsForEdges(*maxEdges));
+		wrongInputError();
+	}
+}
+
 /**
  * @brief Function which is called when the programm exits. Unmaps shared memory and closes semaphores and unlinks both.
  * 
@@ -85,8 +149,14 @@ static void closeUp(void){
 	if(solution_buffer != NULL){
 		solution_buffer->quit = 1;
 		if(freeSem != NULL){
-			for(size_t i = 0; i < solution_buffer->shmTracker;i++){
-				postSem(freeSem, PROGRAM_NAME);
+			// a generator can start sleeping or register itself just after quit was set, so keep waking them up
+			// until every generator left, but never wait longer than a second
+			struct timespec pause = { .tv_sec = 0, .tv_nsec = 10000000 };
+			for(int i = 0; i < 100 && __atomic_load_n(&solution_buffer->shmTracker, __ATOMIC_SEQ_CST) > 0; i++){
+				for(int j = 0; j < __atomic_load_n(&solution_buffer->shmTracker, __ATOMIC_SEQ_CST); j++){
+					postSem(freeSem, PROGRAM_NAME);
+				}
+				nanosleep(&pause, NULL);
 			}
 		}
     }
@@ -97,23 +167,20 @@ static void closeUp(void){
     if(usedSem != NULL){
         closeSem(usedSem, PROGRAM_NAME);
 		unlinkSem(SEM_USED, PROGRAM_NAME);
-    }
-    if(writeSem != NULL){
-        closeSem(writeSem, PROGRAM_NAME);
-		unlinkSem(SEM_WRITE_BLOCK, PROGRAM_NAME);
     }
 	if(solution_buffer != NULL){
-		unmapSHM(solution_buffer, sizeof(*solution_buffer), PROGRAM_NAME);
+		unmapSHM(solution_buffer, shmSize, PROGRAM_NAME);
+		unlinkSHM(PROGRAM_NAME);
 	}
-	unlinkSHM(PROGRAM_NAME);
 }
 
 /**
  * @brief this is the main method which manages the whole program process first we introduce the atexit function
- * which helps us to closeup everything either when closed successfully or not. Next we check if the input is right and
- * introduce the signal handler, then we create our sharedmemory, then we open our 3 semaphores, then we create a best_solution
- * which tells us the current best solution at all time, then we read as long solutions from the memory as we find a perfect graph
- * which is in our case a 3 colorable one
+ * which helps us to closeup everything either when closed successfully or not. Next we parse the capacity of the ring and the
+ * maximum edges of a solution and introduce the signal handler, then we create our sharedmemory with a ring of that size, then we open our 2 semaphores which are only used to sleep
+ * while the ring is empty or full, then we create a best_solution
+ * which tells us the current best solution at all time, then we drain all available solutions from the memory at once
+ * and only print improvements as long as we find no perfect graph which is in our case a 3 colorable one
  * 
  * @param argc 
  * @param argv 
@@ -125,36 +192,44 @@ int main(int argc, char **argv)
         fprintf(stderr, "%s - Couldn't set up closeup function: %s\n", PROGRAM_NAME, strerror(errno));
         exit(EXIT_FAILURE);
     }
-	if(argc > 1){
-		fprintf(stderr, "%s: Arguments are not supported!", PROGRAM_NAME);
-		exit(EXIT_FAILURE);
-	}
+	int capacity;
+	int maxEdges;
+	parseOptions(argc, argv, &capacity, &maxEdges);
 
 	listenToSignal();
 	shmfd = openSHM(PROGRAM_NAME);
-	truncateSHM(shmfd, sizeof(shm_t), PROGRAM_NAME);
-    solution_buffer = mapSHM(shmfd, sizeof(*solution_buffer), PROGRAM_NAME);
+	shmSize = ringSize(capacity);
+	truncateSHM(shmfd, shmSize, PROGRAM_NAME);
+    solution_buffer = mapSHM(shmfd, shmSize, PROGRAM_NAME);
     shmfd = -1;
 
 	solution_buffer->quit = 0;
-	solution_buffer->write = 0;
-	solution_buffer->readPos = 0;
 	solution_buffer->shmTracker = 0;
+	solution_buffer->bestEdges = maxEdges+1;
+	initRing(solution_buffer, capacity, maxEdges);
 
-	openSem(&freeSem, SEM_FREE, MAX_DATA, 0, PROGRAM_NAME);
+	openSem(&freeSem, SEM_FREE, 0, 0, PROGRAM_NAME);
 	openSem(&usedSem ,SEM_USED, 0, 0, PROGRAM_NAME);
-	openSem(&writeSem, SEM_WRITE_BLOCK, 1, 0, PROGRAM_NAME);
 	
-	solution_t bestSolution = { .numberOfEdges = MAX_EDGES+1};
+	edge_t *bestEdges = malloc(sizeof(edge_t) * maxEdges);
+	edge_t *drainedEdges = malloc(sizeof(edge_t) * maxEdges);
+	if(bestEdges == NULL || drainedEdges == NULL){
+		fprintf(stderr, "%s - Couldn't allocate memory: %s\n", PROGRAM_NAME, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	solution_t bestSolution = { .edges = bestEdges, .numberOfEdges = maxEdges+1};
 
 	while(solution_buffer->quit == 0){
-		waitSem(usedSem, PROGRAM_NAME);
-		if(overwriteSolutionIfBetter(solution_buffer->solutions[solution_buffer->readPos], &bestSolution) == 0){
+		// only the best solution of everything drained can be an improvement
+		solution_t drained = { .edges = drainedEdges, .numberOfEdges = maxEdges+1};
+		if(readSolutions(solution_buffer, &drained, freeSem, usedSem, PROGRAM_NAME) == 0){
+			continue;
+		}
+		if(overwriteSolutionIfBetter(drained, &bestSolution) == 0){
 			break;
 		}
-		solution_buffer->readPos = (solution_buffer->readPos+1) % MAX_EDGES;
-		
-		postSem(freeSem, PROGRAM_NAME);
 	}
+	free(drainedEdges);
+	free(bestEdges);
 	exit(EXIT_SUCCESS);
 } 
\ No newline at end of file
@@ -0,0 +1,139 @@
+/**
+ * @file admission.c
+ * @author Maximilian Gaber 52009273
+ * @brief Admission control for new connections. The number of open connections and the connections per client
+ * address are counted in one anonymous mapping which is shared between the workers, so the limits hold for the
+ * whole server no matter which worker the kernel hands a connection to
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/**
+ * @brief Number of counters for client addresses, addresses which hash to the same counter share their limit
+ *
+ */
+#define ADMISSION_SLOTS 65536
+
+typedef enum admission_result
+{
+	ADMITTED,
+	REJECTED_FULL,
+	REJECTED_ADDRESS
+} admission_result;
+
+/**
+ * @brief The shared counters and the limits, a limit of 0 disables it and its counter isn't touched at all
+ *
+ */
+typedef struct admission
+{
+	uint64_t *active;
+	uint32_t *addresses;
+	long max_connections;
+	long max_per_address;
+} admission;
+
+/**
+ * @brief maps the shared counters, this has to happen before the workers are forked
+ *
+ * @param admission
+ * @param max_connections
+ * @param max_per_address
+ * @return int 0 on success -1 on error
+ */
+static int admission_init(admission *admission, long max_connections, long max_per_address)
+{
+	admission->max_connections = max_connections;
+	admission->max_per_address = max_per_address;
+	size_t size = sizeof(uint64_t) + ADMISSION_SLOTS * sizeof(uint32_t);
+	void *counters = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counters == MAP_FAILED)
+	{
+		return -1;
+	}
+	admission->active = counters;
+	admission->addresses = (uint32_t *)(admission->active + 1);
+	return 0;
+}
+
+/**
+ * @brief returns the counter of the client address, the port is ignored
+ *
+ * @param address
+ * @return uint32_t
+ */
+static uint32_t admission_slot(const struct sockaddr_storage *address)
+{
+	const unsigned char *bytes = NULL;
+	size_t len = 0;
+	if (address->ss_family == AF_INET)
+	{
+		bytes = (const unsigned char *)&((const struct sockaddr_in *)address)->sin_addr;
+		len = sizeof(struct in_addr);
+	}
+	else if (address->ss_family == AF_INET6)
+	{
+		bytes = (const unsigned char *)&((const struct sockaddr_in6 *)address)->sin6_addr;
+		len = sizeof(struct in6_addr);
+	}
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash % ADMISSION_SLOTS;
+}
+
+/**
+ * @brief counts a new connection if it is within the limits
+ *
+ * @param admission
+ * @param slot of the client address
+ * @return admission_result ADMITTED if the connection was counted and has to be left with admission_leave
+ */
+static admission_result admission_enter(admission *admission, uint32_t slot)
+{
+	if (admission->max_connections > 0 && __atomic_add_fetch(admission->active, 1, __ATOMIC_RELAXED) > (uint64_t)admission->max_connections)
+	{
+		__atomic_sub_fetch(admission->active, 1, __ATOMIC_RELAXED);
+		return REJECTED_FULL;
+	}
+	if (admission->max_per_address > 0 &&
+		__atomic_add_fetch(&admission->addresses[slot], 1, __ATOMIC_RELAXED) > (uint32_t)admission->max_per_address)
+	{
+		__atomic_sub_fetch(&admission->addresses[slot], 1, __ATOMIC_RELAXED);
+		if (admission->max_connections > 0)
+		{
+			__atomic_sub_fetch(admission->active, 1, __ATOMIC_RELAXED);
+		}
+		return REJECTED_ADDRESS;
+	}
+	return ADMITTED;
+}
+
+/**
+ * @brief uncounts a closed connection
+ *
+ * @param admission
+ * @param slot of the client address
+ */
+static void admission_leave(admission *admission, uint32_t slot)
+{
+	if (admission->max_connections > 0)
+	{
+		__atomic_sub_fetch(admission->active, 1, __ATOMIC_RELAXED);
+	}
+	if (admission->max_per_address > 0)
+	{
+		__atomic_sub_fetch(&admission->addresses[slot], 1, __ATOMIC_RELAXED);
+	}
+}
@@ -20,9 +20,57 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <zlib.h>
+
+#include "httpparser.c"
+
+/**
+ * @brief Size of the buffer the response header has to fit in
+ *
+ */
+#define RESPONSE_BUFFER_SIZE 8192
+
+/**
+ * @brief Size of the buffer response bodies are streamed through
+ *
+ */
+#define BODY_BUFFER_SIZE (256 * 1024)
+
+/**
+ * @brief Values below this many microseconds get their own bucket in the latency histogram,
+ * above it every power of two is split into BENCH_SUB_BUCKETS buckets
+ *
+ */
+#define BENCH_LINEAR_BUCKETS 64
+#define BENCH_SUB_BUCKETS 32
+#define BENCH_BUCKETS (BENCH_LINEAR_BUCKETS + 40 * BENCH_SUB_BUCKETS)
+
+/**
+ * @brief Number of requests of a benchmark when neither -n nor -t is given
+ *
+ */
+#define BENCH_DEFAULT_REQUESTS 10000
+
+/**
+ * @brief Number of parallel connections when fetching many URLs without -j
+ *
+ */
+#define FETCH_DEFAULT_JOBS 16
 
 static char *program_name = "<not set>";
 FILE *out_file, *socket_file;
+static char response[RESPONSE_BUFFER_SIZE];
+static size_t response_len = 0;
+static size_t body_start = 0;
+static long resume_offset = 0;
+static bool gzip_encoded = false;
+static http_body response_body;
 
 typedef struct client_url
 {
@@ -37,15 +85,143 @@ typedef struct client_input
 	char *file;
 	char *dir;
 	client_url url;
+	long connections;
+	long requests;
+	long duration;
+	bool resume;
+	char *list;
+	long jobs;
 } client_input;
 
+typedef enum bench_state
+{
+	BENCH_CONNECTING,
+	BENCH_SENDING,
+	BENCH_RECEIVING
+} bench_state;
+
+/**
+ * @brief One connection of the load generator, it has at most one outstanding request
+ *
+ */
+typedef struct bench_connection
+{
+	int fd;
+	bench_state state;
+	size_t request_sent;
+	char buffer[RESPONSE_BUFFER_SIZE];
+	size_t buffer_len;
+	http_parser parser;
+	bool head_done;
+	http_body body;
+	bool keep_alive;
+	bool ok;
+	uint64_t start;
+} bench_connection;
+
+/**
+ * @brief Results of a benchmark, latencies are in microseconds
+ *
+ */
+typedef struct bench_stats
+{
+	uint64_t histogram[BENCH_BUCKETS];
+	uint64_t started;
+	uint64_t completed;
+	uint64_t errors;
+	uint64_t bytes;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+} bench_stats;
+
+typedef enum fetch_state
+{
+	FETCH_CONNECTING,
+	FETCH_SENDING,
+	FETCH_RECEIVING
+} fetch_state;
+
+struct fetch_host;
+
+/**
+ * @brief One URL to fetch, failed is the exit status of a failed fetch
+ *
+ */
+typedef struct fetch_job
+{
+	char *text;
+	client_url url;
+	char path[PATH_MAX];
+	struct fetch_host *host;
+	int attempts;
+	int failed;
+	struct fetch_job *next;
+} fetch_job;
+
+/**
+ * @brief A host with the jobs which still wait for a connection
+ *
+ */
+typedef struct fetch_host
+{
+	const char *name;
+	struct addrinfo *ai;
+	fetch_job *pending_head;
+	fetch_job *pending_tail;
+	size_t pending;
+	long connections;
+} fetch_host;
+
+/**
+ * @brief One connection of the fetcher, it has at most one outstanding request and is reused for the
+ * next job of its host
+ *
+ */
+typedef struct fetch_connection
+{
+	int fd;
+	fetch_state state;
+	fetch_host *host;
+	fetch_job *job;
+	char request[PATH_MAX + 256];
+	size_t request_len;
+	size_t request_sent;
+	char buffer[RESPONSE_BUFFER_SIZE];
+	size_t buffer_len;
+	size_t received;
+	http_parser parser;
+	bool head_done;
+	http_body body;
+	bool keep_alive;
+	bool reused;
+	int out_fd;
+	bool created;
+} fetch_connection;
+
+typedef struct fetcher
+{
+	fetch_job *jobs;
+	fetch_host *hosts;
+	size_t host_count;
+	size_t next_host;
+	fetch_connection *connections;
+	long pool_size;
+	long active;
+	size_t completed;
+	int epfd;
+	int status;
+} fetcher;
+
 /**
  * @brief Prints how the programm should be executed and exits with failure called when wrong input
  *
  */
 static void usage(void)
 {
-	fprintf(stderr, "[%s] Usage: [-p PORT] [-o FILE | -d DIR] URL\n", program_name);
+	fprintf(stderr, "[%s] Usage: [-p PORT] [-c] [-o FILE | -d DIR] URL\n", program_name);
+	fprintf(stderr, "[%s] Fetch many: [-p PORT] [-j CONNECTIONS] -d DIR [-i URL_LIST] URL...\n", program_name);
+	fprintf(stderr, "[%s] Benchmark: [-p PORT] -b CONNECTIONS [-n REQUESTS | -t SECONDS] URL\n", program_name);
 	exit(EXIT_FAILURE);
 }
 
@@ -71,6 +247,25 @@ static void exit_with_error(char *message)
 	exit(EXIT_FAILURE);
 }
 
+/**
+ * @brief parses a numeric option argument, calls usage if it is no number or smaller than 1
+ *
+ * @param arg
+ * @return long
+ */
+static long parse_number(char *arg)
+{
+	char *end;
+	errno = 0;
+	long number = strtol(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || number < 1)
+	{
+		fprintf(stderr, "[%s] ERROR: Invalid number %s\n", program_name, arg);
+		usage();
+	}
+	return number;
+}
+
 /**
  * @brief checks if the given filename and given dirname are both set which would be wrong
  * and the an error would be printed and usage would be called
@@ -152,7 +347,8 @@ static client_url parse_url(char *url)
 }
 
 /**
- * @brief opens the specified file where the requested file content should end up
+ * @brief opens the specified file where the requested file content should end up, in resume mode
+ * the file is opened for appending and resume_offset is set to its current size
  *
  * @param client_input
  */
@@ -161,7 +357,7 @@ static void open_file(client_input client_input)
 	out_file = stdout;
 	if (client_input.file != NULL)
 	{
-		out_file = fopen(client_input.file, "w");
+		out_file = fopen(client_input.file, client_input.resume ? "a" : "w");
 	}
 	else if (client_input.dir != NULL)
 	{
@@ -171,13 +367,17 @@ static void open_file(client_input client_input)
 		strcpy(path, client_input.dir);
 		strcat(path, "/");
 		strcat(path, client_input.url.file);
-		out_file = fopen(path, "w");
+		out_file = fopen(path, client_input.resume ? "a" : "w");
 	}
 	if (out_file == NULL)
 	{
 		fprintf(stderr, "[%s] ERROR: Opening file %s failed\n", program_name, client_input.file);
 		exit(EXIT_FAILURE);
 	}
+	if (client_input.resume && (fseek(out_file, 0, SEEK_END) == -1 || (resume_offset = ftell(out_file)) == -1))
+	{
+		exit_with_error("Couldn't determine the size of the existing file!");
+	}
 }
 
 /**
@@ -214,15 +414,50 @@ static void connect_socket_file(client_input client_input)
 	}
 }
 
+/**
+ * @brief checks the answer to a resumed download, 206 appends to the file, 200 means the server sends the whole
+ * file so the existing content is dropped and 416 means there is nothing left to download
+ *
+ * @param parser
+ */
+static void check_resumed_response(http_parser *parser)
+{
+	if (http_span_equals(response, parser->status, "416"))
+	{
+		fprintf(stderr, "[%s] File is already complete\n", program_name);
+		exit(EXIT_SUCCESS);
+	}
+	if (http_span_equals(response, parser->status, "200"))
+	{
+		if (ftruncate(fileno(out_file), 0) == -1)
+		{
+			exit_with_error("Couldn't truncate the existing file!");
+		}
+		return;
+	}
+	const http_header *content_range = http_find_header(parser, response, "Content-Range");
+	char expected[64];
+	int expected_len = snprintf(expected, sizeof(expected), "bytes %ld-", resume_offset);
+	if (content_range == NULL || content_range->value.length < expected_len ||
+		strncmp(response + content_range->value.offset, expected, expected_len) != 0)
+	{
+		fprintf(stderr, "[%s] ERROR: Protocol Error!\n", program_name);
+		exit(2);
+	}
+}
+
 /**
  * @brief sends a request for a file to the server and handles the response if the reponse header is
- * valid the header is skipped and stops where the real content starts
+ * valid the header is parsed and body_start marks where the real content starts. When resume_offset is set
+ * only the rest of the file starting there is requested, otherwise a gzip encoded body is accepted
  *
  * @param client_url
  */
 static void send_receive(client_url client_url)
 {
-	if (fprintf(socket_file, "GET /%s HTTP/1.1\r\nhostname: %s\r\nConnection: close\r\n\r\n", client_url.dir, client_url.hostname) < 0)
+	if (fprintf(socket_file, "GET /%s HTTP/1.1\r\nhostname: %s\r\nConnection: close\r\n", client_url.dir, client_url.hostname) < 0 ||
+		(resume_offset > 0 && fprintf(socket_file, "Range: bytes=%ld-\r\n", resume_offset) < 0) ||
+		(resume_offset == 0 && fputs("Accept-Encoding: gzip\r\n", socket_file) == EOF) || fputs("\r\n", socket_file) == EOF)
 	{
 		exit_with_error("Couldn't write request to socket!");
 	}
@@ -232,133 +467,1312 @@ static void send_receive(client_url client_url)
 		exit_with_error("Failed to flush request to socket!");
 	}
 
-	char *line_buffer = NULL;
-	size_t line_buffer_size = 0;
-
-	if (getline(&line_buffer, &line_buffer_size, socket_file) < 0)
+	http_parser parser;
+	http_parser_init(&parser, true, sizeof(response));
+	http_parse_result result = HTTP_PARSE_INCOMPLETE;
+	while (result == HTTP_PARSE_INCOMPLETE)
 	{
-		fprintf(stderr, "[%s] ERROR: Couldn't read response header!\n", program_name);
-		free(line_buffer);
-		exit(2);
+		ssize_t n = read(fileno(socket_file), response + response_len, sizeof(response) - response_len);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't read response header!\n", program_name);
+			exit(2);
+		}
+		response_len += n;
+		result = http_parse(&parser, response, response_len);
 	}
 
-	char *protocol_version = strtok(line_buffer, " ");
-	char *status_code = strtok(NULL, " ");
-	char *status_description = strtok(NULL, "\r\n");
-
-	if (protocol_version == NULL || status_code == NULL || status_description == NULL)
+	if (result != HTTP_PARSE_DONE || !http_span_equals(response, parser.version, "HTTP/1.1"))
 	{
 		fprintf(stderr, "[%s] ERROR: Protocol Error!\n", program_name);
-		free(line_buffer);
 		exit(2);
 	}
 
-	if (strcmp(protocol_version, "HTTP/1.1") != 0 || (strtol(status_code, NULL, 10) == 0 && strcmp(status_code, "0") != 0))
+	if (resume_offset > 0 && (http_span_equals(response, parser.status, "206") || http_span_equals(response, parser.status, "416")))
 	{
-		fprintf(stderr, "[%s] ERROR: Protocol Error!\n", program_name);
-		free(line_buffer);
-		exit(2);
+		check_resumed_response(&parser);
 	}
-
-	if (strcmp(status_code, "200") != 0)
+	else if (!http_span_equals(response, parser.status, "200"))
 	{
-		fprintf(stderr, "ERROR: %s %s %s!\n", program_name, status_code, status_description);
-		free(line_buffer);
+		fprintf(stderr, "ERROR: %s %.*s %.*s!\n", program_name, (int)parser.status.length, response + parser.status.offset,
+				(int)parser.reason.length, response + parser.reason.offset);
 		exit(3);
 	}
-
-	while (getline(&line_buffer, &line_buffer_size, socket_file) != -1)
+	else if (resume_offset > 0)
 	{
-		if (strcmp(line_buffer, "\r\n") == 0)
-			break;
+		check_resumed_response(&parser);
+	}
+	const http_header *content_encoding = http_find_header(&parser, response, "Content-Encoding");
+	if (content_encoding != NULL && http_span_has_token(response, content_encoding->value, "gzip"))
+	{
+		gzip_encoded = true;
+	}
+	if (http_body_init(&response_body, &parser, response) != HTTP_PARSE_DONE)
+	{
+		fprintf(stderr, "[%s] ERROR: Protocol Error!\n", program_name);
+		exit(2);
 	}
-	free(line_buffer);
+	// everything behind the header is already part of the body
+	body_start = parser.header_end;
 }
 
 /**
- * @brief reads from the socket_file and writes to the out_file
+ * @brief writes the content into the out_file
  *
+ * @param data
+ * @param len
  */
-static void read_write_response(void)
+static void write_out(const char *data, size_t len)
 {
-	char buf[1024];
-	while (fgets(buf, sizeof(buf), socket_file) != NULL)
+	while (len > 0)
 	{
-		fputs(buf, out_file);
+		ssize_t n = write(fileno(out_file), data, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			exit_with_error("Couldn't write response!");
+		}
+		data += n;
+		len -= n;
 	}
 }
 
 /**
- * @brief main function calls clean_up when exited, sets the program_name
- * parses the input, if the input is correct the url is parsed
- * opens the file, connects to the socket, send and receive and at the end read and write the response
+ * @brief decompresses the next part of the gzip encoded content into the out_file
  *
- * @param argc
- * @param argv
- * @return int
+ * @param stream
+ * @param data
+ * @param len
+ * @return int the result of the last inflate call
  */
-int main(int argc, char *argv[])
+static int inflate_out(z_stream *stream, char *data, size_t len)
 {
-	program_name = argv[0];
+	static char out[BODY_BUFFER_SIZE];
+	int res = Z_OK;
+	stream->next_in = (Bytef *)data;
+	stream->avail_in = len;
+	do
+	{
+		stream->next_out = (Bytef *)out;
+		stream->avail_out = sizeof(out);
+		res = inflate(stream, Z_NO_FLUSH);
+		if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't decompress response: %s\n", program_name, stream->msg != NULL ? stream->msg : "?");
+			exit(2);
+		}
+		write_out(out, sizeof(out) - stream->avail_out);
+	} while (stream->avail_out == 0 && res != Z_STREAM_END);
+	return res;
+}
 
-	if (atexit(clean_up) < 0)
+/**
+ * @brief streams the body into the out_file, starting with the part which was read together with the header.
+ * The body ends after Content-Length bytes, with the last chunk or when the server closes the connection,
+ * a body which ends too early is an error. A gzip encoded body is decompressed on the way
+ *
+ */
+static void read_write_response(void)
+{
+	static char buffer[BODY_BUFFER_SIZE];
+	z_stream stream;
+	int inflate_res = Z_STREAM_END;
+	if (gzip_encoded)
 	{
-		exit_with_error("Setting up clean_up function didn't work!");
+		memset(&stream, 0, sizeof(stream));
+		// 15 window bits + 32 detects the gzip wrapper
+		if (inflateInit2(&stream, 15 + 32) != Z_OK)
+		{
+			exit_with_error("Couldn't initialize decompression!");
+		}
+		inflate_res = Z_OK;
 	}
-
-	client_input client_input;
-	client_input.port = "80";
-	bool port_set = false;
-	client_input.file = NULL, client_input.dir = NULL;
-	int opt;
-	while ((opt = getopt(argc, argv, "p:o:d:")) != -1)
+	size_t len = response_len - body_start;
+	memcpy(buffer, response + body_start, len);
+	http_parse_result result = response_body.done ? HTTP_PARSE_DONE : HTTP_PARSE_INCOMPLETE;
+	while (result == HTTP_PARSE_INCOMPLETE)
 	{
-		switch (opt)
+		if (len == 0)
 		{
-		case 'p':
-			if (!port_set)
-			{
-				char *ptr;
-				strtol(optarg, &ptr, 10);
-				if (ptr != '\0')
-				{
-					client_input.port = optarg;
-					port_set = true;
-					break;
-				}
-			}
-			wrong_input("-p can only be set once");
-		case 'o':
-			if (client_input.file == NULL)
+			ssize_t n = read(fileno(socket_file), buffer, sizeof(buffer));
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n == 0 && response_body.mode == HTTP_BODY_CLOSE)
 			{
-				client_input.file = optarg;
-				check_execution(client_input.file, client_input.dir);
 				break;
 			}
-			wrong_input("-o can only be set once");
-		case 'd':
-			if (client_input.dir == NULL)
+			if (n <= 0)
 			{
-				client_input.dir = optarg;
-				check_execution(client_input.file, client_input.dir);
-				break;
+				fprintf(stderr, "[%s] ERROR: Response is truncated!\n", program_name);
+				exit(2);
 			}
-			wrong_input("-d can only be set once");
-		case '?':
-			usage();
-		default:
-			assert(false);
+			len = n;
+		}
+		size_t consumed, decoded;
+		result = http_body_decode(&response_body, buffer, len, &consumed, &decoded);
+		if (result == HTTP_PARSE_ERROR)
+		{
+			fprintf(stderr, "[%s] ERROR: Protocol Error!\n", program_name);
+			exit(2);
+		}
+		if (gzip_encoded)
+		{
+			inflate_res = inflate_out(&stream, buffer, decoded);
 		}
+		else
+		{
+			write_out(buffer, decoded);
+		}
+		len = 0;
+	}
+	if (gzip_encoded)
+	{
+		inflateEnd(&stream);
 	}
+	if (inflate_res != Z_STREAM_END)
+	{
+		fprintf(stderr, "[%s] ERROR: Compressed response is truncated!\n", program_name);
+		exit(2);
+	}
+}
 
-	// Get the URL
-	if (optind != argc - 1)
+/**
+ * @brief returns the monotonic time in microseconds
+ *
+ * @return uint64_t
+ */
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief maps a latency to its histogram bucket, the relative error of a bucket is at most 1/BENCH_SUB_BUCKETS
+ *
+ * @param us
+ * @return size_t
+ */
+static size_t bench_bucket(uint64_t us)
+{
+	if (us < BENCH_LINEAR_BUCKETS)
 	{
-		usage();
+		return us;
 	}
+	int shift = 63 - __builtin_clzll(us) - 5;
+	size_t bucket = BENCH_LINEAR_BUCKETS + (shift - 1) * BENCH_SUB_BUCKETS + ((us >> shift) - BENCH_SUB_BUCKETS);
+	return bucket < BENCH_BUCKETS ? bucket : BENCH_BUCKETS - 1;
+}
 
-	// parse the URL
-	client_input.url = parse_url(argv[optind]);
+/**
+ * @brief returns the smallest latency which falls into the bucket
+ *
+ * @param bucket
+ * @return uint64_t
+ */
+static uint64_t bench_bucket_value(size_t bucket)
+{
+	if (bucket < BENCH_LINEAR_BUCKETS)
+	{
+		return bucket;
+	}
+	int shift = (bucket - BENCH_LINEAR_BUCKETS) / BENCH_SUB_BUCKETS + 1;
+	uint64_t mantissa = (bucket - BENCH_LINEAR_BUCKETS) % BENCH_SUB_BUCKETS + BENCH_SUB_BUCKETS;
+	return mantissa << shift;
+}
+
+/**
+ * @brief returns the latency below which the given fraction of all requests completed
+ *
+ * @param stats
+ * @param fraction
+ * @return uint64_t
+ */
+static uint64_t bench_percentile(bench_stats *stats, double fraction)
+{
+	uint64_t rank = (uint64_t)(fraction * stats->completed + 0.999999);
+	uint64_t count = 0;
+	for (size_t i = 0; i < BENCH_BUCKETS; i++)
+	{
+		count += stats->histogram[i];
+		if (count >= rank && count > 0)
+		{
+			uint64_t value = bench_bucket_value(i);
+			return value > stats->max ? stats->max : value;
+		}
+	}
+	return stats->max;
+}
+
+/**
+ * @brief starts a non blocking connect and registers the socket edge triggered at the epoll instance
+ *
+ * @param ai
+ * @param epfd
+ * @param ptr is returned with every event of the socket
+ * @return int the socket or -1 on error
+ */
+static int connect_nonblocking(struct addrinfo *ai, int epfd, void *ptr)
+{
+	int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	if (connect(fd, ai->ai_addr, ai->ai_addrlen) == -1 && errno != EINPROGRESS)
+	{
+		close(fd);
+		return -1;
+	}
+	struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = ptr};
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief checks if the non blocking connect of the socket finished
+ *
+ * @param fd
+ * @return int 1 if connected, 0 if still connecting, -1 on error
+ */
+static int check_connected(int fd)
+{
+	int error = 0;
+	socklen_t len = sizeof(error);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1 || error != 0)
+	{
+		return error == EINPROGRESS ? 0 : -1;
+	}
+	return 1;
+}
+
+/**
+ * @brief opens a new non blocking connection to the server and registers it at the epoll instance
+ *
+ * @param connection
+ * @param ai
+ * @param epfd
+ * @return int 0 on success -1 on error
+ */
+static int bench_connect(bench_connection *connection, struct addrinfo *ai, int epfd)
+{
+	connection->fd = connect_nonblocking(ai, epfd, connection);
+	connection->state = BENCH_CONNECTING;
+	return connection->fd == -1 ? -1 : 0;
+}
+
+/**
+ * @brief checks if the benchmark should start another request
+ *
+ * @param client_input
+ * @param stats
+ * @param deadline is 0 when the benchmark is limited by the number of requests
+ * @return true if another request should be started
+ */
+static bool bench_more(client_input client_input, bench_stats *stats, uint64_t deadline)
+{
+	if (deadline != 0)
+	{
+		return monotonic_us() < deadline;
+	}
+	return stats->started < (uint64_t)client_input.requests;
+}
+
+/**
+ * @brief prepares the connection to send the next request
+ *
+ * @param connection
+ * @param stats
+ */
+static void bench_start_request(bench_connection *connection, bench_stats *stats)
+{
+	connection->request_sent = 0;
+	connection->buffer_len = 0;
+	connection->head_done = false;
+	connection->start = monotonic_us();
+	stats->started++;
+}
+
+/**
+ * @brief records the finished response
+ *
+ * @param connection
+ * @param stats
+ */
+static void bench_complete(bench_connection *connection, bench_stats *stats)
+{
+	if (!connection->ok)
+	{
+		stats->errors++;
+		return;
+	}
+	uint64_t latency = monotonic_us() - connection->start;
+	stats->histogram[bench_bucket(latency)]++;
+	stats->completed++;
+	stats->sum += latency;
+	if (stats->completed == 1 || latency < stats->min)
+	{
+		stats->min = latency;
+	}
+	if (latency > stats->max)
+	{
+		stats->max = latency;
+	}
+}
+
+/**
+ * @brief decodes received body bytes and counts the content
+ *
+ * @param connection
+ * @param stats
+ * @param data
+ * @param len
+ * @return int 1 if the response is complete, 0 if more body is expected, -1 on error
+ */
+static int bench_count_body(bench_connection *connection, bench_stats *stats, char *data, size_t len)
+{
+	size_t consumed, decoded;
+	http_parse_result result = http_body_decode(&connection->body, data, len, &consumed, &decoded);
+	stats->bytes += decoded;
+	if (result == HTTP_PARSE_ERROR)
+	{
+		return -1;
+	}
+	return result == HTTP_PARSE_DONE;
+}
+
+/**
+ * @brief looks at the completely received response head, the body bytes behind it are counted
+ *
+ * @param connection
+ * @param stats
+ * @return int 1 if the response is complete, 0 if more body is expected, -1 on error
+ */
+static int bench_handle_head(bench_connection *connection, bench_stats *stats)
+{
+	http_parser *parser = &connection->parser;
+	char *buffer = connection->buffer;
+	connection->head_done = true;
+	connection->ok = http_span_equals(buffer, parser->status, "200");
+	if (http_body_init(&connection->body, parser, buffer) != HTTP_PARSE_DONE)
+	{
+		return -1;
+	}
+	const http_header *connection_header = http_find_header(parser, buffer, "Connection");
+	connection->keep_alive = connection->body.mode != HTTP_BODY_CLOSE &&
+							 (connection_header == NULL || !http_span_has_token(buffer, connection_header->value, "close"));
+	if (connection->body.done)
+	{
+		return 1;
+	}
+	return bench_count_body(connection, stats, buffer + parser->header_end, connection->buffer_len - parser->header_end);
+}
+
+/**
+ * @brief drives the connection as far as the socket allows it
+ *
+ * @param connection
+ * @param request
+ * @param request_len
+ * @param stats
+ * @return int 1 if the response is complete, 0 if the socket is not ready, -1 on error
+ */
+static int bench_drive(bench_connection *connection, const char *request, size_t request_len, bench_stats *stats)
+{
+	while (true)
+	{
+		if (connection->state == BENCH_CONNECTING)
+		{
+			int res = check_connected(connection->fd);
+			if (res != 1)
+			{
+				return res;
+			}
+			connection->state = BENCH_SENDING;
+		}
+		else if (connection->state == BENCH_SENDING)
+		{
+			ssize_t n = write(connection->fd, request + connection->request_sent, request_len - connection->request_sent);
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				// still connecting or socket full
+				return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN ? 0 : -1;
+			}
+			connection->request_sent += n;
+			if (connection->request_sent == request_len)
+			{
+				http_parser_init(&connection->parser, true, sizeof(connection->buffer));
+				connection->state = BENCH_RECEIVING;
+			}
+		}
+		else
+		{
+			// the body is not needed, once the head is parsed the buffer is reused for it
+			size_t offset = connection->head_done ? 0 : connection->buffer_len;
+			ssize_t n = read(connection->fd, connection->buffer + offset, sizeof(connection->buffer) - offset);
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+			}
+			if (n == 0)
+			{
+				if (connection->head_done && connection->body.mode == HTTP_BODY_CLOSE)
+				{
+					return 1;
+				}
+				return -1;
+			}
+			if (connection->head_done)
+			{
+				int res = bench_count_body(connection, stats, connection->buffer, n);
+				if (res != 0)
+				{
+					return res;
+				}
+				continue;
+			}
+			connection->buffer_len += n;
+			http_parse_result result = http_parse(&connection->parser, connection->buffer, connection->buffer_len);
+			if (result == HTTP_PARSE_DONE)
+			{
+				int res = bench_handle_head(connection, stats);
+				if (res != 0)
+				{
+					return res;
+				}
+			}
+			else if (result != HTTP_PARSE_INCOMPLETE)
+			{
+				return -1;
+			}
+		}
+	}
+}
+
+/**
+ * @brief prints the results of the benchmark to stdout
+ *
+ * @param stats
+ * @param elapsed in microseconds
+ */
+static void bench_report(bench_stats *stats, uint64_t elapsed)
+{
+	double seconds = elapsed / 1e6;
+	fprintf(stdout, "requests:   %llu completed, %llu errors in %.3f s\n", (unsigned long long)stats->completed,
+			(unsigned long long)stats->errors, seconds);
+	fprintf(stdout, "throughput: %.1f requests/s, %.2f MiB/s\n", stats->completed / seconds, stats->bytes / seconds / (1 << 20));
+	if (stats->completed == 0)
+	{
+		return;
+	}
+	fprintf(stdout, "latency:    min %llu us, mean %llu us, max %llu us\n", (unsigned long long)stats->min,
+			(unsigned long long)(stats->sum / stats->completed), (unsigned long long)stats->max);
+	fprintf(stdout, "            p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us\n",
+			(unsigned long long)bench_percentile(stats, 0.5), (unsigned long long)bench_percentile(stats, 0.9),
+			(unsigned long long)bench_percentile(stats, 0.99), (unsigned long long)bench_percentile(stats, 0.999));
+}
+
+/**
+ * @brief runs the load generator, client_input.connections connections request the url over and over again
+ * on persistent connections until client_input.requests requests are done or client_input.duration seconds passed
+ *
+ * @param client_input
+ */
+static void run_benchmark(client_input client_input)
+{
+	struct addrinfo hints, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(client_input.url.hostname, client_input.port, &hints, &ai) != 0)
+	{
+		exit_with_error("Couldn't get address information!");
+	}
+	int request_len = snprintf(NULL, 0, "GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n", client_input.url.dir, client_input.url.hostname);
+	char request[request_len + 1];
+	snprintf(request, sizeof(request), "GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n", client_input.url.dir, client_input.url.hostname);
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	bench_connection *connections = calloc(client_input.connections, sizeof(*connections));
+	bench_stats *stats = calloc(1, sizeof(*stats));
+	if (epfd == -1 || connections == NULL || stats == NULL)
+	{
+		exit_with_error("Couldn't set up the benchmark!");
+	}
+
+	uint64_t begin = monotonic_us();
+	uint64_t deadline = client_input.duration > 0 ? begin + client_input.duration * 1000000 : 0;
+	long active = 0;
+	for (long i = 0; i < client_input.connections && bench_more(client_input, stats, deadline); i++)
+	{
+		if (bench_connect(&connections[i], ai, epfd) == -1)
+		{
+			exit_with_error("Couldn't connect to socket!");
+		}
+		bench_start_request(&connections[i], stats);
+		active++;
+	}
+
+	struct epoll_event events[64];
+	while (active > 0)
+	{
+		int n = epoll_wait(epfd, events, 64, 100);
+		if (n == -1 && errno != EINTR)
+		{
+			exit_with_error("Couldn't wait for events!");
+		}
+		for (int i = 0; i < n; i++)
+		{
+			bench_connection *connection = events[i].data.ptr;
+			while (true)
+			{
+				int res = bench_drive(connection, request, request_len, stats);
+				if (res == 0)
+				{
+					break;
+				}
+				if (res == -1)
+				{
+					// a kept alive connection may have been closed by the server, retry on a fresh one
+					connection->ok = false;
+					connection->keep_alive = false;
+				}
+				bench_complete(connection, stats);
+				if (!connection->keep_alive || !bench_more(client_input, stats, deadline))
+				{
+					close(connection->fd);
+					connection->fd = -1;
+					if (!bench_more(client_input, stats, deadline) || bench_connect(connection, ai, epfd) == -1)
+					{
+						active--;
+						break;
+					}
+				}
+				else
+				{
+					connection->state = BENCH_SENDING;
+				}
+				bench_start_request(connection, stats);
+			}
+		}
+	}
+	bench_report(stats, monotonic_us() - begin);
+	freeaddrinfo(ai);
+	free(connections);
+	free(stats);
+	close(epfd);
+}
+
+/**
+ * @brief reads the URL list file, every line is one URL, empty lines and lines starting with '#' are skipped
+ *
+ * @param path
+ * @param count is set to the number of URLs
+ * @return char** the URLs, they live until the program exits
+ */
+static char **read_url_list(const char *path, size_t *count)
+{
+	FILE *list = fopen(path, "r");
+	if (list == NULL)
+	{
+		fprintf(stderr, "[%s] ERROR: Opening URL list %s failed\n", program_name, path);
+		exit(EXIT_FAILURE);
+	}
+	char **urls = NULL;
+	size_t capacity = 0;
+	*count = 0;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	while ((len = getline(&line, &line_size, list)) != -1)
+	{
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+		{
+			line[--len] = '\0';
+		}
+		if (len == 0 || line[0] == '#')
+		{
+			continue;
+		}
+		if (*count == capacity)
+		{
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			urls = realloc(urls, capacity * sizeof(*urls));
+		}
+		if (urls == NULL || (urls[*count] = strdup(line)) == NULL)
+		{
+			exit_with_error("Couldn't read the URL list!");
+		}
+		(*count)++;
+	}
+	free(line);
+	fclose(list);
+	return urls;
+}
+
+/**
+ * @brief maps the path of the url below the output directory, a path ending with '/' gets index.html,
+ * query and fragment are dropped. Missing directories are created
+ *
+ * @param dir
+ * @param url
+ * @param path
+ * @param size
+ * @return int 0 on success, -1 if the url path leaves the directory or is too long
+ */
+static int fetch_output_path(const char *dir, client_url url, char *path, size_t size)
+{
+	size_t url_path_len = strcspn(url.dir, "?#");
+	const char *file = url_path_len == 0 || url.dir[url_path_len - 1] == '/' ? "index.html" : "";
+	if (snprintf(path, size, "%s/%.*s%s", dir, (int)url_path_len, url.dir, file) >= (int)size)
+	{
+		return -1;
+	}
+	size_t dir_len = strlen(dir);
+	for (char *segment = path + dir_len + 1; *segment != '\0';)
+	{
+		size_t segment_len = strcspn(segment, "/");
+		if (segment_len == 2 && strncmp(segment, "..", 2) == 0)
+		{
+			return -1;
+		}
+		if (segment[segment_len] == '\0')
+		{
+			break;
+		}
+		segment[segment_len] = '\0';
+		int res = mkdir(path, 0755);
+		segment[segment_len] = '/';
+		if (res == -1 && errno != EEXIST)
+		{
+			return -1;
+		}
+		segment += segment_len + 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief returns the host of the url, every host is only resolved once
+ *
+ * @param fetcher
+ * @param hostname
+ * @param port
+ * @return fetch_host*
+ */
+static fetch_host *fetch_find_host(fetcher *fetcher, const char *hostname, const char *port)
+{
+	for (size_t i = 0; i < fetcher->host_count; i++)
+	{
+		if (strcmp(fetcher->hosts[i].name, hostname) == 0)
+		{
+			return &fetcher->hosts[i];
+		}
+	}
+	fetch_host *host = &fetcher->hosts[fetcher->host_count++];
+	memset(host, 0, sizeof(*host));
+	host->name = hostname;
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(hostname, port, &hints, &host->ai) != 0)
+	{
+		fprintf(stderr, "[%s] ERROR: Couldn't get address information of %s!\n", program_name, hostname);
+		exit(EXIT_FAILURE);
+	}
+	return host;
+}
+
+/**
+ * @brief queues the job at its host
+ *
+ * @param job
+ * @param front true to fetch it next, used for retries
+ */
+static void fetch_queue(fetch_job *job, bool front)
+{
+	fetch_host *host = job->host;
+	job->next = NULL;
+	if (host->pending_head == NULL)
+	{
+		host->pending_head = host->pending_tail = job;
+	}
+	else if (front)
+	{
+		job->next = host->pending_head;
+		host->pending_head = job;
+	}
+	else
+	{
+		host->pending_tail->next = job;
+		host->pending_tail = job;
+	}
+	host->pending++;
+}
+
+/**
+ * @brief takes the next job of the host and prepares the connection to send its request
+ *
+ * @param connection
+ */
+static void fetch_start_job(fetch_connection *connection)
+{
+	fetch_host *host = connection->host;
+	fetch_job *job = host->pending_head;
+	host->pending_head = job->next;
+	if (host->pending_head == NULL)
+	{
+		host->pending_tail = NULL;
+	}
+	host->pending--;
+	job->attempts++;
+	connection->job = job;
+	connection->request_len = snprintf(connection->request, sizeof(connection->request), "GET /%s HTTP/1.1\r\nHost: %s\r\n\r\n",
+									   job->url.dir, host->name);
+	connection->request_sent = 0;
+	connection->buffer_len = 0;
+	connection->received = 0;
+	connection->head_done = false;
+	connection->out_fd = -1;
+	connection->created = false;
+}
+
+/**
+ * @brief opens a new connection to the host and starts its next job
+ *
+ * @param fetcher
+ * @param connection
+ * @param host
+ * @return int 0 on success -1 on error
+ */
+static int fetch_connect(fetcher *fetcher, fetch_connection *connection, fetch_host *host)
+{
+	connection->fd = connect_nonblocking(host->ai, fetcher->epfd, connection);
+	if (connection->fd == -1)
+	{
+		return -1;
+	}
+	connection->state = FETCH_CONNECTING;
+	connection->host = host;
+	connection->reused = false;
+	host->connections++;
+	fetch_start_job(connection);
+	return 0;
+}
+
+/**
+ * @brief decodes the received body bytes and writes the content into the output file of the job
+ *
+ * @param connection
+ * @param data
+ * @param len
+ * @return int 0 on success -1 on error
+ */
+static int fetch_write_body(fetch_connection *connection, char *data, size_t len)
+{
+	size_t consumed, decoded;
+	if (http_body_decode(&connection->body, data, len, &consumed, &decoded) == HTTP_PARSE_ERROR)
+	{
+		return -1;
+	}
+	if (consumed < len)
+	{
+		// more than the body, the connection can't be trusted for the next response
+		connection->keep_alive = false;
+	}
+	len = decoded;
+	while (connection->out_fd != -1 && len > 0)
+	{
+		ssize_t n = write(connection->out_fd, data, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "[%s] ERROR: Couldn't write %s: %s\n", program_name, connection->job->path, strerror(errno));
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief looks at the completely received response head, the output file is only created for 200
+ *
+ * @param connection
+ * @return int 0 on success -1 on error
+ */
+static int fetch_handle_head(fetch_connection *connection)
+{
+	http_parser *parser = &connection->parser;
+	char *buffer = connection->buffer;
+	connection->head_done = true;
+	if (!http_span_equals(buffer, parser->version, "HTTP/1.1") || http_body_init(&connection->body, parser, buffer) != HTTP_PARSE_DONE)
+	{
+		return -1;
+	}
+	const http_header *connection_header = http_find_header(parser, buffer, "Connection");
+	connection->keep_alive = connection->body.mode != HTTP_BODY_CLOSE &&
+							 (connection_header == NULL || !http_span_has_token(buffer, connection_header->value, "close"));
+	if (!http_span_equals(buffer, parser->status, "200"))
+	{
+		fprintf(stderr, "[%s] ERROR: %s: %.*s %.*s!\n", program_name, connection->job->text, (int)parser->status.length,
+				buffer + parser->status.offset, (int)parser->reason.length, buffer + parser->reason.offset);
+		connection->job->failed = 3;
+	}
+	else
+	{
+		connection->out_fd = open(connection->job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (connection->out_fd == -1)
+		{
+			fprintf(stderr, "[%s] ERROR: Opening file %s failed: %s\n", program_name, connection->job->path, strerror(errno));
+			return -1;
+		}
+		connection->created = true;
+	}
+	return fetch_write_body(connection, buffer + parser->header_end, connection->buffer_len - parser->header_end);
+}
+
+/**
+ * @brief drives the connection as far as the socket allows it
+ *
+ * @param connection
+ * @return int 1 if the response is complete, 0 if the socket is not ready, -1 on error
+ */
+static int fetch_drive(fetch_connection *connection)
+{
+	static char body[BODY_BUFFER_SIZE];
+	while (true)
+	{
+		if (connection->state == FETCH_CONNECTING)
+		{
+			int res = check_connected(connection->fd);
+			if (res != 1)
+			{
+				return res;
+			}
+			connection->state = FETCH_SENDING;
+		}
+		else if (connection->state == FETCH_SENDING)
+		{
+			ssize_t n = write(connection->fd, connection->request + connection->request_sent, connection->request_len - connection->request_sent);
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN ? 0 : -1;
+			}
+			connection->request_sent += n;
+			if (connection->request_sent == connection->request_len)
+			{
+				http_parser_init(&connection->parser, true, sizeof(connection->buffer));
+				connection->state = FETCH_RECEIVING;
+			}
+		}
+		else if (connection->head_done && connection->body.done)
+		{
+			return 1;
+		}
+		else
+		{
+			char *target = connection->head_done ? body : connection->buffer + connection->buffer_len;
+			size_t size = connection->head_done ? sizeof(body) : sizeof(connection->buffer) - connection->buffer_len;
+			ssize_t n = read(connection->fd, target, size);
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+			}
+			if (n == 0)
+			{
+				return connection->head_done && connection->body.mode == HTTP_BODY_CLOSE ? 1 : -1;
+			}
+			connection->received += n;
+			if (connection->head_done)
+			{
+				if (fetch_write_body(connection, body, n) == -1)
+				{
+					return -1;
+				}
+				continue;
+			}
+			connection->buffer_len += n;
+			http_parse_result result = http_parse(&connection->parser, connection->buffer, connection->buffer_len);
+			if (result == HTTP_PARSE_DONE)
+			{
+				if (fetch_handle_head(connection) == -1)
+				{
+					return -1;
+				}
+			}
+			else if (result != HTTP_PARSE_INCOMPLETE)
+			{
+				return -1;
+			}
+		}
+	}
+}
+
+/**
+ * @brief finishes the job of the connection, a job which failed on a reused connection before anything was received
+ * is queued again because the server may just have closed the idle connection
+ *
+ * @param fetcher
+ * @param connection
+ * @param res of fetch_drive
+ */
+static void fetch_finish_job(fetcher *fetcher, fetch_connection *connection, int res)
+{
+	fetch_job *job = connection->job;
+	connection->job = NULL;
+	if (connection->out_fd != -1)
+	{
+		if (close(connection->out_fd) == -1 && res == 1)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't write %s: %s\n", program_name, job->path, strerror(errno));
+			res = -1;
+		}
+		connection->out_fd = -1;
+	}
+	if (res == -1)
+	{
+		connection->keep_alive = false;
+		if (connection->reused && connection->received == 0 && job->attempts < 2)
+		{
+			fetch_queue(job, true);
+			return;
+		}
+		if (connection->created && job->failed == 0)
+		{
+			// a truncated or unwritable file must not look complete, a file this job never opened isn't touched
+			unlink(job->path);
+		}
+		if (job->failed == 0)
+		{
+			fprintf(stderr, "[%s] ERROR: %s: Couldn't fetch the file!\n", program_name, job->text);
+			job->failed = 2;
+		}
+	}
+	if (job->failed > fetcher->status)
+	{
+		fetcher->status = job->failed;
+	}
+	fetcher->completed++;
+}
+
+/**
+ * @brief opens connections for waiting jobs until the pool is full, hosts are visited round robin and
+ * never get more connections than they have waiting jobs
+ *
+ * @param fetcher
+ */
+static void fetch_fill_pool(fetcher *fetcher)
+{
+	for (size_t visited = 0; visited < fetcher->host_count && fetcher->active < fetcher->pool_size;)
+	{
+		fetch_host *host = &fetcher->hosts[fetcher->next_host];
+		fetcher->next_host = (fetcher->next_host + 1) % fetcher->host_count;
+		if (host->pending == 0)
+		{
+			visited++;
+			continue;
+		}
+		visited = 0;
+		fetch_connection *connection = NULL;
+		for (long i = 0; i < fetcher->pool_size && connection == NULL; i++)
+		{
+			if (fetcher->connections[i].fd == -1)
+			{
+				connection = &fetcher->connections[i];
+			}
+		}
+		if (fetch_connect(fetcher, connection, host) == -1)
+		{
+			exit_with_error("Couldn't connect to socket!");
+		}
+		fetcher->active++;
+	}
+}
+
+/**
+ * @brief fetches all urls into the output directory over a bounded pool of non blocking connections,
+ * a connection is kept alive and reused for the next url of the same host
+ *
+ * @param client_input
+ * @param urls
+ * @param url_count
+ * @return int exit status, 0 if every file was fetched, 3 if the server answered with an error, 2 on other errors
+ */
+static int run_fetcher(client_input client_input, char **urls, size_t url_count)
+{
+	fetcher fetcher;
+	memset(&fetcher, 0, sizeof(fetcher));
+	fetcher.pool_size = client_input.jobs;
+	fetcher.jobs = calloc(url_count, sizeof(*fetcher.jobs));
+	fetcher.hosts = calloc(url_count, sizeof(*fetcher.hosts));
+	fetcher.connections = calloc(fetcher.pool_size, sizeof(*fetcher.connections));
+	fetcher.epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (fetcher.jobs == NULL || fetcher.hosts == NULL || fetcher.connections == NULL || fetcher.epfd == -1)
+	{
+		exit_with_error("Couldn't set up the fetcher!");
+	}
+	for (long i = 0; i < fetcher.pool_size; i++)
+	{
+		fetcher.connections[i].fd = -1;
+	}
+
+	for (size_t i = 0; i < url_count; i++)
+	{
+		fetch_job *job = &fetcher.jobs[i];
+		job->text = urls[i];
+		char *copy = strdup(urls[i]);
+		if (copy == NULL)
+		{
+			exit_with_error("Couldn't parse URL!");
+		}
+		job->url = parse_url(copy);
+		if (fetch_output_path(client_input.dir, job->url, job->path, sizeof(job->path)) == -1)
+		{
+			fprintf(stderr, "[%s] ERROR: %s can't be stored below %s!\n", program_name, urls[i], client_input.dir);
+			fetcher.status = 2;
+			fetcher.completed++;
+			continue;
+		}
+		job->host = fetch_find_host(&fetcher, job->url.hostname, client_input.port);
+		fetch_queue(job, false);
+	}
+
+	struct epoll_event events[64];
+	while (fetcher.completed < url_count)
+	{
+		fetch_fill_pool(&fetcher);
+		int n = epoll_wait(fetcher.epfd, events, 64, -1);
+		if (n == -1 && errno != EINTR)
+		{
+			exit_with_error("Couldn't wait for events!");
+		}
+		for (int i = 0; i < n; i++)
+		{
+			fetch_connection *connection = events[i].data.ptr;
+			while (true)
+			{
+				int res = fetch_drive(connection);
+				if (res == 0)
+				{
+					break;
+				}
+				fetch_finish_job(&fetcher, connection, res);
+				if (connection->keep_alive && connection->host->pending > 0)
+				{
+					connection->state = FETCH_SENDING;
+					connection->reused = true;
+					fetch_start_job(connection);
+					continue;
+				}
+				close(connection->fd);
+				connection->fd = -1;
+				connection->host->connections--;
+				fetcher.active--;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < fetcher.host_count; i++)
+	{
+		freeaddrinfo(fetcher.hosts[i].ai);
+	}
+	free(fetcher.jobs);
+	free(fetcher.hosts);
+	free(fetcher.connections);
+	close(fetcher.epfd);
+	return fetcher.status;
+}
+
+/**
+ * @brief main function calls clean_up when exited, sets the program_name
+ * parses the input, if the input is correct the url is parsed
+ * opens the file, connects to the socket, send and receive and at the end read and write the response
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[])
+{
+	program_name = argv[0];
+
+	if (atexit(clean_up) < 0)
+	{
+		exit_with_error("Setting up clean_up function didn't work!");
+	}
+
+	client_input client_input;
+	client_input.port = "80";
+	bool port_set = false;
+	client_input.file = NULL, client_input.dir = NULL;
+	client_input.connections = 0, client_input.requests = 0, client_input.duration = 0;
+	client_input.resume = false;
+	client_input.list = NULL, client_input.jobs = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "p:o:d:b:n:t:ci:j:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			if (!port_set)
+			{
+				char *ptr;
+				strtol(optarg, &ptr, 10);
+				if (ptr != '\0')
+				{
+					client_input.port = optarg;
+					port_set = true;
+					break;
+				}
+			}
+			wrong_input("-p can only be set once");
+		case 'o':
+			if (client_input.file == NULL)
+			{
+				client_input.file = optarg;
+				check_execution(client_input.file, client_input.dir);
+				break;
+			}
+			wrong_input("-o can only be set once");
+		case 'd':
+			if (client_input.dir == NULL)
+			{
+				client_input.dir = optarg;
+				check_execution(client_input.file, client_input.dir);
+				break;
+			}
+			wrong_input("-d can only be set once");
+		case 'c':
+			if (!client_input.resume)
+			{
+				client_input.resume = true;
+				break;
+			}
+			wrong_input("-c can only be set once");
+		case 'b':
+			if (client_input.connections == 0)
+			{
+				client_input.connections = parse_number(optarg);
+				break;
+			}
+			wrong_input("-b can only be set once");
+		case 'n':
+			if (client_input.requests == 0 && client_input.duration == 0)
+			{
+				client_input.requests = parse_number(optarg);
+				break;
+			}
+			wrong_input("-n can only be set once and not together with -t");
+		case 't':
+			if (client_input.requests == 0 && client_input.duration == 0)
+			{
+				client_input.duration = parse_number(optarg);
+				break;
+			}
+			wrong_input("-t can only be set once and not together with -n");
+		case 'i':
+			if (client_input.list == NULL)
+			{
+				client_input.list = optarg;
+				break;
+			}
+			wrong_input("-i can only be set once");
+		case 'j':
+			if (client_input.jobs == 0)
+			{
+				client_input.jobs = parse_number(optarg);
+				break;
+			}
+			wrong_input("-j can only be set once");
+		case '?':
+			usage();
+		default:
+			assert(false);
+		}
+	}
+
+	// many URLs are fetched in parallel into the directory
+	if (client_input.list != NULL || argc - optind > 1)
+	{
+		if (client_input.dir == NULL || client_input.resume || client_input.connections > 0)
+		{
+			wrong_input("fetching many URLs needs -d and can't be combined with -c or -b");
+		}
+		size_t url_count = 0;
+		char **urls = client_input.list != NULL ? read_url_list(client_input.list, &url_count) : NULL;
+		urls = realloc(urls, (url_count + argc - optind + 1) * sizeof(*urls));
+		if (urls == NULL)
+		{
+			exit_with_error("Couldn't collect the URLs!");
+		}
+		for (int i = optind; i < argc; i++)
+		{
+			urls[url_count++] = argv[i];
+		}
+		if (client_input.jobs == 0)
+		{
+			client_input.jobs = FETCH_DEFAULT_JOBS;
+		}
+		int status = url_count > 0 ? run_fetcher(client_input, urls, url_count) : EXIT_SUCCESS;
+		free(urls);
+		exit(status);
+	}
+	if (client_input.jobs != 0)
+	{
+		wrong_input("-j can only be used when fetching many URLs");
+	}
+
+	// Get the URL
+	if (optind != argc - 1)
+	{
+		usage();
+	}
+
+	// parse the URL
+	client_input.url = parse_url(argv[optind]);
+
+	if (client_input.connections > 0)
+	{
+		if (client_input.file != NULL || client_input.dir != NULL)
+		{
+			wrong_input("-b cannot be set together with -o or -d");
+		}
+		if (client_input.requests == 0 && client_input.duration == 0)
+		{
+			client_input.requests = BENCH_DEFAULT_REQUESTS;
+		}
+		run_benchmark(client_input);
+		exit(EXIT_SUCCESS);
+	}
+	if (client_input.requests != 0 || client_input.duration != 0)
+	{
+		wrong_input("-n and -t can only be used with -b");
+	}
+	if (client_input.resume && client_input.file == NULL && client_input.dir == NULL)
+	{
+		wrong_input("-c needs a file to continue, set -o or -d");
+	}
 
 	open_file(client_input);
 	connect_socket_file(client_input);
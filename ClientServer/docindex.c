@@ -0,0 +1,283 @@
+/**
+ * @file docindex.c
+ * @author Maximilian Gaber 52009273
+ * @brief Index of all files below the doc root which is built once at startup. Lookups need no system call,
+ * unknown paths can be rejected without touching the disk and small files are mapped read only so they can be
+ * sent straight from the mapping. The index is a snapshot, it has to be rebuilt when the doc root changes
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Files up to this size are mapped when the index is built
+ *
+ */
+#define DOC_INDEX_MAX_MAPPED_SIZE (256 * 1024)
+
+/**
+ * @brief One regular file of the doc root, path is relative to the doc root
+ * mapped holds the mapping and prebuilt header of small files, the index owns one reference of it
+ *
+ */
+typedef struct doc_entry
+{
+	char *path;
+	uint64_t hash;
+	struct stat file_stat;
+	cache_entry *mapped;
+	struct doc_entry *next;
+} doc_entry;
+
+/**
+ * @brief The index, bucket_count is 0 if no index was built
+ *
+ */
+typedef struct doc_index
+{
+	doc_entry **buckets;
+	size_t bucket_count;
+	size_t entry_count;
+	size_t mapped_count;
+	size_t mapped_bytes;
+	size_t root_len;
+} doc_index;
+
+/**
+ * @brief formats the header lines which describe a file, they become part of the prebuilt header of mapped files
+ *
+ */
+typedef size_t (*doc_headers)(const char *path, const struct stat *file_stat, char *buffer, size_t size);
+
+/**
+ * @brief maps the file into a cache entry which isn't part of any cache, it is freed when its last reference is released
+ *
+ * @param full_path
+ * @param file_stat
+ * @param headers
+ * @return cache_entry* or NULL if the file couldn't be mapped
+ */
+static cache_entry *doc_index_map(const char *full_path, const struct stat *file_stat, doc_headers headers)
+{
+	char *body = NULL;
+	if (file_stat->st_size > 0)
+	{
+		int fd = open(full_path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+		{
+			return NULL;
+		}
+		body = mmap(NULL, file_stat->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (body == MAP_FAILED)
+		{
+			return NULL;
+		}
+	}
+	char header_lines[512];
+	headers(full_path, file_stat, header_lines, sizeof(header_lines));
+	cache_entry *entry = cache_new_entry(full_path, false, file_stat, 0, header_lines, body, file_stat->st_size);
+	if (entry == NULL)
+	{
+		if (body != NULL)
+		{
+			munmap(body, file_stat->st_size);
+		}
+		return NULL;
+	}
+	entry->mapped = body != NULL;
+	entry->evicted = true;
+	entry->refs = 1;
+	return entry;
+}
+
+/**
+ * @brief adds one file to the index
+ *
+ * @param index
+ * @param full_path
+ * @param file_stat
+ * @param headers
+ * @return int 0 on success -1 on error
+ */
+static int doc_index_add(doc_index *index, const char *full_path, const struct stat *file_stat, doc_headers headers)
+{
+	if (index->entry_count >= index->bucket_count)
+	{
+		size_t bucket_count = index->bucket_count * 2;
+		doc_entry **buckets = calloc(bucket_count, sizeof(*buckets));
+		if (buckets == NULL)
+		{
+			return -1;
+		}
+		for (size_t i = 0; i < index->bucket_count; i++)
+		{
+			for (doc_entry *entry = index->buckets[i], *next; entry != NULL; entry = next)
+			{
+				next = entry->next;
+				entry->next = buckets[entry->hash & (bucket_count - 1)];
+				buckets[entry->hash & (bucket_count - 1)] = entry;
+			}
+		}
+		free(index->buckets);
+		index->buckets = buckets;
+		index->bucket_count = bucket_count;
+	}
+	doc_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL || (entry->path = strdup(full_path + index->root_len + 1)) == NULL)
+	{
+		free(entry);
+		return -1;
+	}
+	entry->hash = cache_hash(entry->path, false);
+	entry->file_stat = *file_stat;
+	if (file_stat->st_size <= DOC_INDEX_MAX_MAPPED_SIZE)
+	{
+		// a failed mapping only means the file is opened on every request
+		entry->mapped = doc_index_map(full_path, file_stat, headers);
+		if (entry->mapped != NULL)
+		{
+			index->mapped_count++;
+			index->mapped_bytes += file_stat->st_size;
+		}
+	}
+	doc_entry **bucket = &index->buckets[entry->hash & (index->bucket_count - 1)];
+	entry->next = *bucket;
+	*bucket = entry;
+	index->entry_count++;
+	return 0;
+}
+
+/**
+ * @brief adds all regular files below the directory, symbolic links to files are followed but not links to directories
+ *
+ * @param index
+ * @param path of the directory, it is extended in place while walking
+ * @param len of the path
+ * @param headers
+ * @return int 0 on success -1 on error
+ */
+static int doc_index_walk(doc_index *index, char *path, size_t len, doc_headers headers)
+{
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+	{
+		return -1;
+	}
+	int res = 0;
+	struct dirent *dirent;
+	while (res == 0 && (dirent = readdir(dir)) != NULL)
+	{
+		if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0)
+		{
+			continue;
+		}
+		size_t name_len = strlen(dirent->d_name);
+		if (len + 1 + name_len >= PATH_MAX)
+		{
+			continue;
+		}
+		path[len] = '/';
+		memcpy(path + len + 1, dirent->d_name, name_len + 1);
+		struct stat file_stat;
+		if (lstat(path, &file_stat) == 0 && S_ISDIR(file_stat.st_mode))
+		{
+			res = doc_index_walk(index, path, len + 1 + name_len, headers);
+		}
+		else if (stat(path, &file_stat) == 0 && S_ISREG(file_stat.st_mode))
+		{
+			res = doc_index_add(index, path, &file_stat, headers);
+		}
+	}
+	path[len] = '\0';
+	closedir(dir);
+	return res;
+}
+
+/**
+ * @brief frees the index, mapped files which are still sent stay alive until their last reference is released
+ *
+ * @param index
+ */
+static void doc_index_free(doc_index *index)
+{
+	for (size_t i = 0; i < index->bucket_count; i++)
+	{
+		for (doc_entry *entry = index->buckets[i], *next; entry != NULL; entry = next)
+		{
+			next = entry->next;
+			if (entry->mapped != NULL)
+			{
+				cache_release(entry->mapped);
+			}
+			free(entry->path);
+			free(entry);
+		}
+	}
+	free(index->buckets);
+	memset(index, 0, sizeof(*index));
+}
+
+/**
+ * @brief builds the index of all files below the doc root
+ *
+ * @param index
+ * @param doc_root
+ * @param headers
+ * @return int 0 on success -1 on error, the index is empty then
+ */
+static int doc_index_build(doc_index *index, const char *doc_root, doc_headers headers)
+{
+	memset(index, 0, sizeof(*index));
+	char path[PATH_MAX];
+	index->root_len = strlen(doc_root);
+	if (index->root_len >= sizeof(path))
+	{
+		return -1;
+	}
+	memcpy(path, doc_root, index->root_len + 1);
+	index->bucket_count = CACHE_INITIAL_BUCKETS;
+	index->buckets = calloc(index->bucket_count, sizeof(*index->buckets));
+	if (index->buckets == NULL || doc_index_walk(index, path, index->root_len, headers) == -1)
+	{
+		doc_index_free(index);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief looks up the file the server would open, leading slashes after the doc root are ignored
+ *
+ * @param index
+ * @param full_path doc root and requested path
+ * @return doc_entry* or NULL if there is no such file
+ */
+static doc_entry *doc_index_find(doc_index *index, const char *full_path)
+{
+	const char *path = full_path + index->root_len;
+	while (*path == '/')
+	{
+		path++;
+	}
+	uint64_t hash = cache_hash(path, false);
+	doc_entry *entry = index->buckets[hash & (index->bucket_count - 1)];
+	while (entry != NULL && (entry->hash != hash || strcmp(entry->path, path) != 0))
+	{
+		entry = entry->next;
+	}
+	return entry;
+}
@@ -0,0 +1,581 @@
+/**
+ * @file filecache.c
+ * @author Maximilian Gaber 52009273
+ * @brief Size limited LRU cache which keeps hot files of the doc root with their preformatted header in memory,
+ * every file can be cached as is and as gzip encoded variant
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/**
+ * @brief Files bigger than this are never cached, they are sent with sendfile
+ *
+ */
+#define CACHE_MAX_ENTRY_SIZE (1 << 20)
+
+/**
+ * @brief Number of hash buckets the cache starts with, always a power of two
+ *
+ */
+#define CACHE_INITIAL_BUCKETS 256
+
+/**
+ * @brief What is known about the gzip encoded variant of a file as it is
+ * GZIP_UNKNOWN nobody looked for it yet
+ * GZIP_SIBLING it is the precompressed file.gz next to the file
+ * GZIP_COMPRESSED there is no file.gz, the file is compressed into the cache
+ * GZIP_NONE there is no file.gz and the file is too small or couldn't be compressed
+ *
+ */
+typedef enum gzip_variant
+{
+	GZIP_UNKNOWN,
+	GZIP_SIBLING,
+	GZIP_COMPRESSED,
+	GZIP_NONE
+} gzip_variant;
+
+/**
+ * @brief One cached file, the entry stays valid as long as refs is bigger than 0 even when it is evicted
+ * dev, ino, file_size and mtime are compared against stat at most once per second to detect changed files
+ * gzip marks the gzip encoded variant of the file at path, its body is the encoded file
+ * gzip_variant remembers for the file as it is where its encoded variant comes from, a changed file gets a new entry
+ * mapped marks a body which is a read only mapping of the file instead of a copy
+ *
+ */
+typedef struct cache_entry
+{
+	char *path;
+	bool gzip;
+	gzip_variant gzip_variant;
+	uint64_t hash;
+	char *header;
+	size_t header_len;
+	char *body;
+	size_t size;
+	bool mapped;
+	off_t file_size;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	time_t validated;
+	unsigned int refs;
+	bool evicted;
+	struct cache_entry *hash_next;
+	struct cache_entry *lru_prev;
+	struct cache_entry *lru_next;
+} cache_entry;
+
+/**
+ * @brief The cache itself, lru_head is the most and lru_tail the least recently used entry
+ * used counts the bytes of all bodies and is never bigger than capacity
+ *
+ */
+typedef struct file_cache
+{
+	cache_entry **buckets;
+	size_t bucket_count;
+	size_t entry_count;
+	cache_entry *lru_head;
+	cache_entry *lru_tail;
+	size_t capacity;
+	size_t used;
+} file_cache;
+
+/**
+ * @brief FNV-1a hash of the path and the variant
+ *
+ * @param path
+ * @param gzip
+ * @return uint64_t
+ */
+static uint64_t cache_hash(const char *path, bool gzip)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (const unsigned char *c = (const unsigned char *)path; *c != '\0'; c++)
+	{
+		hash = (hash ^ *c) * 1099511628211ULL;
+	}
+	return (hash ^ gzip) * 1099511628211ULL;
+}
+
+/**
+ * @brief finds the entry of the path and variant
+ *
+ * @param cache
+ * @param path
+ * @param gzip
+ * @param hash of path and variant
+ * @return cache_entry* or NULL
+ */
+static cache_entry *cache_find(file_cache *cache, const char *path, bool gzip, uint64_t hash)
+{
+	cache_entry *entry = cache->buckets[hash & (cache->bucket_count - 1)];
+	while (entry != NULL && (entry->hash != hash || entry->gzip != gzip || strcmp(entry->path, path) != 0))
+	{
+		entry = entry->hash_next;
+	}
+	return entry;
+}
+
+/**
+ * @brief initializes an empty cache which holds at most capacity bytes, a capacity of 0 disables the cache
+ *
+ * @param cache
+ * @param capacity
+ */
+static void cache_init(file_cache *cache, size_t capacity)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->capacity = capacity;
+	if (capacity == 0)
+	{
+		return;
+	}
+	cache->buckets = calloc(CACHE_INITIAL_BUCKETS, sizeof(*cache->buckets));
+	if (cache->buckets == NULL)
+	{
+		cache->capacity = 0;
+		return;
+	}
+	cache->bucket_count = CACHE_INITIAL_BUCKETS;
+}
+
+/**
+ * @brief frees the entry
+ *
+ * @param entry
+ */
+static void cache_free_entry(cache_entry *entry)
+{
+	free(entry->path);
+	free(entry->header);
+	if (entry->mapped)
+	{
+		munmap(entry->body, entry->size);
+	}
+	else
+	{
+		free(entry->body);
+	}
+	free(entry);
+}
+
+/**
+ * @brief unlinks the entry from the lru list
+ *
+ * @param cache
+ * @param entry
+ */
+static void cache_lru_unlink(file_cache *cache, cache_entry *entry)
+{
+	if (entry->lru_prev != NULL)
+	{
+		entry->lru_prev->lru_next = entry->lru_next;
+	}
+	else
+	{
+		cache->lru_head = entry->lru_next;
+	}
+	if (entry->lru_next != NULL)
+	{
+		entry->lru_next->lru_prev = entry->lru_prev;
+	}
+	else
+	{
+		cache->lru_tail = entry->lru_prev;
+	}
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+/**
+ * @brief puts the entry in front of the lru list
+ *
+ * @param cache
+ * @param entry
+ */
+static void cache_lru_push(file_cache *cache, cache_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	if (cache->lru_head != NULL)
+	{
+		cache->lru_head->lru_prev = entry;
+	}
+	cache->lru_head = entry;
+	if (cache->lru_tail == NULL)
+	{
+		cache->lru_tail = entry;
+	}
+}
+
+/**
+ * @brief removes the entry from the cache, it is freed as soon as nobody sends it anymore
+ *
+ * @param cache
+ * @param entry
+ */
+static void cache_remove(file_cache *cache, cache_entry *entry)
+{
+	cache_entry **link = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+	while (*link != entry)
+	{
+		link = &(*link)->hash_next;
+	}
+	*link = entry->hash_next;
+	cache_lru_unlink(cache, entry);
+	cache->used -= entry->size;
+	cache->entry_count--;
+	entry->evicted = true;
+	if (entry->refs == 0)
+	{
+		cache_free_entry(entry);
+	}
+}
+
+/**
+ * @brief gives back an entry which was returned by cache_lookup or cache_insert
+ *
+ * @param entry
+ */
+static void cache_release(cache_entry *entry)
+{
+	entry->refs--;
+	if (entry->refs == 0 && entry->evicted)
+	{
+		cache_free_entry(entry);
+	}
+}
+
+/**
+ * @brief doubles the number of buckets when there are more entries than buckets
+ *
+ * @param cache
+ */
+static void cache_grow(file_cache *cache)
+{
+	size_t bucket_count = cache->bucket_count * 2;
+	cache_entry **buckets = calloc(bucket_count, sizeof(*buckets));
+	if (buckets == NULL)
+	{
+		return;
+	}
+	for (size_t i = 0; i < cache->bucket_count; i++)
+	{
+		cache_entry *entry = cache->buckets[i];
+		while (entry != NULL)
+		{
+			cache_entry *next = entry->hash_next;
+			entry->hash_next = buckets[entry->hash & (bucket_count - 1)];
+			buckets[entry->hash & (bucket_count - 1)] = entry;
+			entry = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->bucket_count = bucket_count;
+}
+
+/**
+ * @brief checks if the file behind the entry changed since it was cached, stat is only called once per second
+ *
+ * @param entry
+ * @param now
+ * @return true if the entry can still be used
+ */
+static bool cache_validate(cache_entry *entry, time_t now)
+{
+	if (entry->validated == now)
+	{
+		return true;
+	}
+	struct stat file_stat;
+	if (stat(entry->path, &file_stat) == -1 || file_stat.st_dev != entry->dev || file_stat.st_ino != entry->ino ||
+		file_stat.st_size != entry->file_size || file_stat.st_mtim.tv_sec != entry->mtime.tv_sec ||
+		file_stat.st_mtim.tv_nsec != entry->mtime.tv_nsec)
+	{
+		return false;
+	}
+	entry->validated = now;
+	return true;
+}
+
+/**
+ * @brief looks up the variant of the path, stale entries are removed
+ *
+ * @param cache
+ * @param path
+ * @param gzip true for the gzip encoded variant
+ * @param now
+ * @return cache_entry* with a reference which has to be given back with cache_release or NULL on a miss
+ */
+static cache_entry *cache_lookup(file_cache *cache, const char *path, bool gzip, time_t now)
+{
+	if (cache->capacity == 0)
+	{
+		return NULL;
+	}
+	cache_entry *entry = cache_find(cache, path, gzip, cache_hash(path, gzip));
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+	if (!cache_validate(entry, now))
+	{
+		cache_remove(cache, entry);
+		return NULL;
+	}
+	cache_lru_unlink(cache, entry);
+	cache_lru_push(cache, entry);
+	entry->refs++;
+	return entry;
+}
+
+/**
+ * @brief checks if the file can be cached at all
+ *
+ * @param cache
+ * @param file_stat
+ * @return true if it is small enough
+ */
+static bool cache_accepts(file_cache *cache, const struct stat *file_stat)
+{
+	return cache->capacity != 0 && S_ISREG(file_stat->st_mode) && file_stat->st_size <= CACHE_MAX_ENTRY_SIZE &&
+		   (size_t)file_stat->st_size <= cache->capacity;
+}
+
+/**
+ * @brief reads the whole opened file into a new buffer
+ *
+ * @param fd is the opened file, its offset is not changed
+ * @param size of the file
+ * @return char* which has to be freed or NULL on error
+ */
+static char *cache_read_file(int fd, size_t size)
+{
+	char *body = malloc(size > 0 ? size : 1);
+	if (body == NULL)
+	{
+		return NULL;
+	}
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = pread(fd, body + done, size - done, done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			free(body);
+			return NULL;
+		}
+		done += n;
+	}
+	return body;
+}
+
+/**
+ * @brief compresses the body in gzip format
+ *
+ * @param body
+ * @param size
+ * @param compressed_size is set to the size of the result
+ * @return char* which has to be freed or NULL on error
+ */
+static char *cache_gzip(const char *body, size_t size, size_t *compressed_size)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// 15 window bits + 16 selects the gzip wrapper instead of zlib
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return NULL;
+	}
+	size_t bound = deflateBound(&stream, size);
+	char *compressed = malloc(bound);
+	if (compressed == NULL)
+	{
+		deflateEnd(&stream);
+		return NULL;
+	}
+	stream.next_in = (Bytef *)body;
+	stream.avail_in = size;
+	stream.next_out = (Bytef *)compressed;
+	stream.avail_out = bound;
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+	{
+		deflateEnd(&stream);
+		free(compressed);
+		return NULL;
+	}
+	*compressed_size = stream.total_out;
+	deflateEnd(&stream);
+	return compressed;
+}
+
+/**
+ * @brief creates an entry with its prebuilt header which isn't part of a cache yet
+ *
+ * @param path
+ * @param gzip
+ * @param file_stat of the file at path
+ * @param now
+ * @param headers are header lines describing the file which become part of the prebuilt header
+ * @param body is owned by the entry on success
+ * @param size of the body
+ * @return cache_entry* or NULL on error
+ */
+static cache_entry *cache_new_entry(const char *path, bool gzip, const struct stat *file_stat, time_t now, const char *headers,
+									char *body, size_t size)
+{
+	cache_entry *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL)
+	{
+		return NULL;
+	}
+	entry->path = strdup(path);
+	// the header is allocated with its exact length, so no header lines are ever cut off
+	int header_len = snprintf(NULL, 0, "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n%s", (unsigned long)size, headers);
+	if (header_len >= 0)
+	{
+		entry->header = malloc(header_len + 1);
+	}
+	if (entry->path == NULL || entry->header == NULL)
+	{
+		cache_free_entry(entry);
+		return NULL;
+	}
+	snprintf(entry->header, header_len + 1, "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n%s", (unsigned long)size, headers);
+	entry->body = body;
+	entry->header_len = header_len;
+	entry->gzip = gzip;
+	entry->hash = cache_hash(path, gzip);
+	entry->size = size;
+	entry->file_size = file_stat->st_size;
+	entry->dev = file_stat->st_dev;
+	entry->ino = file_stat->st_ino;
+	entry->mtime = file_stat->st_mtim;
+	entry->validated = now;
+	return entry;
+}
+
+/**
+ * @brief caches the body, least recently used entries are evicted until it fits
+ *
+ * @param cache
+ * @param path
+ * @param gzip
+ * @param file_stat of the file at path
+ * @param now
+ * @param headers are header lines describing the file which become part of the prebuilt header
+ * @param body is owned by the cache afterwards
+ * @param size of the body
+ * @return cache_entry* with a reference which has to be given back with cache_release or NULL if it isn't cached
+ */
+static cache_entry *cache_store(file_cache *cache, const char *path, bool gzip, const struct stat *file_stat, time_t now,
+								const char *headers, char *body, size_t size)
+{
+	cache_entry *entry = size <= cache->capacity ? cache_new_entry(path, gzip, file_stat, now, headers, body, size) : NULL;
+	if (entry == NULL)
+	{
+		free(body);
+		return NULL;
+	}
+
+	// another connection may have cached the same file in the meantime
+	cache_entry *old = cache_find(cache, path, gzip, entry->hash);
+	if (old != NULL)
+	{
+		cache_remove(cache, old);
+	}
+	while (cache->used + size > cache->capacity && cache->lru_tail != NULL)
+	{
+		cache_remove(cache, cache->lru_tail);
+	}
+	if (cache->entry_count >= cache->bucket_count)
+	{
+		cache_grow(cache);
+	}
+	cache_entry **bucket = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+	entry->hash_next = *bucket;
+	*bucket = entry;
+	cache_lru_push(cache, entry);
+	cache->used += size;
+	cache->entry_count++;
+	entry->refs = 1;
+	return entry;
+}
+
+/**
+ * @brief reads the opened file into memory and caches it as it is
+ *
+ * @param cache
+ * @param path
+ * @param gzip true if the file itself is the gzip encoded variant, e.g. a precompressed file.gz
+ * @param fd is the opened file, its offset is not changed
+ * @param file_stat of the opened file
+ * @param now
+ * @param headers are header lines describing the file which become part of the prebuilt header
+ * @return cache_entry* with a reference which has to be given back with cache_release or NULL if it isn't cached
+ */
+static cache_entry *cache_insert(file_cache *cache, const char *path, bool gzip, int fd, const struct stat *file_stat, time_t now,
+								 const char *headers)
+{
+	if (!cache_accepts(cache, file_stat))
+	{
+		return NULL;
+	}
+	char *body = cache_read_file(fd, file_stat->st_size);
+	if (body == NULL)
+	{
+		return NULL;
+	}
+	return cache_store(cache, path, gzip, file_stat, now, headers, body, file_stat->st_size);
+}
+
+/**
+ * @brief compresses the body of the cached or mapped file as it is and caches it as gzip encoded variant
+ *
+ * @param cache
+ * @param path
+ * @param identity is the entry of the file as it is
+ * @param now
+ * @param headers are header lines describing the encoded file which become part of the prebuilt header
+ * @return cache_entry* with a reference which has to be given back with cache_release or NULL if it isn't cached
+ */
+static cache_entry *cache_insert_gzip(file_cache *cache, const char *path, const cache_entry *identity, time_t now,
+									  const char *headers)
+{
+	if (cache->capacity == 0)
+	{
+		return NULL;
+	}
+	size_t size;
+	char *compressed = cache_gzip(identity->body, identity->size, &size);
+	if (compressed == NULL)
+	{
+		return NULL;
+	}
+	// the encoded variant is valid as long as the file it was compressed from is unchanged
+	struct stat file_stat;
+	memset(&file_stat, 0, sizeof(file_stat));
+	file_stat.st_dev = identity->dev;
+	file_stat.st_ino = identity->ino;
+	file_stat.st_size = identity->file_size;
+	file_stat.st_mtim = identity->mtime;
+	return cache_store(cache, path, true, &file_stat, now, headers, compressed, size);
+}
@@ -0,0 +1,636 @@
+/**
+ * @file httpparser.c
+ * @author Maximilian Gaber 52009273
+ * @brief Incremental HTTP/1.1 head parser and body decoder used by client and server. It works in place on the caller's buffer,
+ * never allocates and can be resumed whenever more bytes arrived on a non blocking socket. Functions which only one of
+ * client and server uses are marked unused
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Maximum number of header lines in one request or response
+ *
+ */
+#define HTTP_MAX_HEADERS 32
+
+/**
+ * @brief Results of http_parse
+ * HTTP_PARSE_INCOMPLETE the head isn't complete yet, call again when more bytes arrived
+ * HTTP_PARSE_DONE the whole head is parsed and header_end is its length
+ * HTTP_PARSE_ERROR the head is malformed
+ * HTTP_PARSE_TOO_LARGE the head is longer than max_header_size or has more than HTTP_MAX_HEADERS headers
+ *
+ */
+typedef enum http_parse_result
+{
+	HTTP_PARSE_INCOMPLETE,
+	HTTP_PARSE_DONE,
+	HTTP_PARSE_ERROR,
+	HTTP_PARSE_TOO_LARGE
+} http_parse_result;
+
+/**
+ * @brief Part of the parsed buffer, offsets are relative to the start of the buffer so the spans stay valid
+ * if the caller moves the buffer
+ *
+ */
+typedef struct http_span
+{
+	size_t offset;
+	size_t length;
+} http_span;
+
+typedef struct http_header
+{
+	http_span name;
+	http_span value;
+} http_header;
+
+typedef enum http_parser_state
+{
+	HTTP_START_LINE,
+	HTTP_HEADERS,
+	HTTP_DONE
+} http_parser_state;
+
+/**
+ * @brief State of one parsed head. Requests fill method, target and version,
+ * responses fill version, status and reason
+ *
+ */
+typedef struct http_parser
+{
+	http_parser_state state;
+	bool response;
+	size_t max_header_size;
+	size_t offset;
+	size_t line_start;
+	size_t header_end;
+	http_span method;
+	http_span target;
+	http_span version;
+	http_span status;
+	http_span reason;
+	http_header headers[HTTP_MAX_HEADERS];
+	size_t header_count;
+} http_parser;
+
+/**
+ * @brief prepares the parser for a new head
+ *
+ * @param parser
+ * @param response true to parse a status line instead of a request line
+ * @param max_header_size is the maximum length of the whole head
+ */
+static void http_parser_init(http_parser *parser, bool response, size_t max_header_size)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->response = response;
+	parser->max_header_size = max_header_size;
+}
+
+/**
+ * @brief compares the span case insensitive with the string
+ *
+ * @param buffer
+ * @param span
+ * @param string
+ * @return true if they are equal
+ */
+static bool http_span_equals(const char *buffer, http_span span, const char *string)
+{
+	return strlen(string) == span.length && strncasecmp(buffer + span.offset, string, span.length) == 0;
+}
+
+/**
+ * @brief finds the first header with the given name
+ *
+ * @param parser
+ * @param buffer
+ * @param name
+ * @return const http_header* or NULL if there is no such header
+ */
+static const http_header *http_find_header(const http_parser *parser, const char *buffer, const char *name)
+{
+	for (size_t i = 0; i < parser->header_count; i++)
+	{
+		if (http_span_equals(buffer, parser->headers[i].name, name))
+		{
+			return &parser->headers[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief checks if the comma separated list in the span contains the token, e.g. "close" in "Connection: close"
+ *
+ * @param buffer
+ * @param span
+ * @param token
+ * @return true if the token is in the list
+ */
+static bool http_span_has_token(const char *buffer, http_span span, const char *token)
+{
+	size_t i = 0;
+	while (i < span.length)
+	{
+		while (i < span.length && (buffer[span.offset + i] == ' ' || buffer[span.offset + i] == '\t' || buffer[span.offset + i] == ','))
+		{
+			i++;
+		}
+		size_t start = i;
+		while (i < span.length && buffer[span.offset + i] != ',')
+		{
+			i++;
+		}
+		size_t end = i;
+		while (end > start && (buffer[span.offset + end - 1] == ' ' || buffer[span.offset + end - 1] == '\t'))
+		{
+			end--;
+		}
+		http_span item = {.offset = span.offset + start, .length = end - start};
+		if (end > start && http_span_equals(buffer, item, token))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief checks if an Accept-Encoding list accepts the coding, either by name or by "*", "gzip;q=0" rejects it
+ *
+ * @param buffer
+ * @param span of the header value
+ * @param coding
+ * @return true if the coding is acceptable
+ */
+__attribute__((unused)) static bool http_accepts_coding(const char *buffer, http_span span, const char *coding)
+{
+	bool accepted = false;
+	bool named = false;
+	size_t i = 0;
+	while (i < span.length)
+	{
+		while (i < span.length && (buffer[span.offset + i] == ' ' || buffer[span.offset + i] == '\t' || buffer[span.offset + i] == ','))
+		{
+			i++;
+		}
+		size_t start = i;
+		while (i < span.length && buffer[span.offset + i] != ',' && buffer[span.offset + i] != ';' && buffer[span.offset + i] != ' ' &&
+			   buffer[span.offset + i] != '\t')
+		{
+			i++;
+		}
+		http_span name = {.offset = span.offset + start, .length = i - start};
+		// a weight of zero means "not acceptable", every other weight is good enough for us
+		bool rejected = false;
+		while (i < span.length && buffer[span.offset + i] != ',')
+		{
+			if ((buffer[span.offset + i] == 'q' || buffer[span.offset + i] == 'Q') && i + 1 < span.length && buffer[span.offset + i + 1] == '=')
+			{
+				size_t j = i + 2;
+				rejected = j < span.length && buffer[span.offset + j] == '0';
+				for (j++; rejected && j < span.length && buffer[span.offset + j] != ',' && buffer[span.offset + j] != ';'; j++)
+				{
+					rejected = buffer[span.offset + j] == '0' || buffer[span.offset + j] == '.' || buffer[span.offset + j] == ' ';
+				}
+			}
+			i++;
+		}
+		if (http_span_equals(buffer, name, coding))
+		{
+			named = true;
+			accepted = !rejected;
+		}
+		else if (!named && http_span_equals(buffer, name, "*"))
+		{
+			accepted = !rejected;
+		}
+	}
+	return accepted;
+}
+
+/**
+ * @brief splits off the next part of the line which ends at the separator
+ *
+ * @param buffer
+ * @param position is moved behind the separator
+ * @param end of the line
+ * @param rest true if the part should take the rest of the line
+ * @return http_span
+ */
+static http_span http_next_part(const char *buffer, size_t *position, size_t end, bool rest)
+{
+	http_span span = {.offset = *position, .length = 0};
+	while (*position < end && (rest || buffer[*position] != ' '))
+	{
+		(*position)++;
+	}
+	span.length = *position - span.offset;
+	if (*position < end)
+	{
+		(*position)++;
+	}
+	return span;
+}
+
+/**
+ * @brief parses the request or status line
+ *
+ * @param parser
+ * @param buffer
+ * @param start
+ * @param end
+ * @return http_parse_result
+ */
+static http_parse_result http_parse_start_line(http_parser *parser, const char *buffer, size_t start, size_t end)
+{
+	for (size_t i = start; i < end; i++)
+	{
+		if (buffer[i] == '\0' || buffer[i] == '\r')
+		{
+			return HTTP_PARSE_ERROR;
+		}
+	}
+	size_t position = start;
+	if (parser->response)
+	{
+		parser->version = http_next_part(buffer, &position, end, false);
+		parser->status = http_next_part(buffer, &position, end, false);
+		parser->reason = http_next_part(buffer, &position, end, true);
+		if (parser->version.length == 0 || parser->status.length != 3)
+		{
+			return HTTP_PARSE_ERROR;
+		}
+		for (size_t i = 0; i < 3; i++)
+		{
+			if (buffer[parser->status.offset + i] < '0' || buffer[parser->status.offset + i] > '9')
+			{
+				return HTTP_PARSE_ERROR;
+			}
+		}
+		return HTTP_PARSE_INCOMPLETE;
+	}
+	parser->method = http_next_part(buffer, &position, end, false);
+	parser->target = http_next_part(buffer, &position, end, false);
+	parser->version = http_next_part(buffer, &position, end, false);
+	if (parser->method.length == 0 || parser->target.length == 0 || parser->version.length == 0 || position != end)
+	{
+		return HTTP_PARSE_ERROR;
+	}
+	return HTTP_PARSE_INCOMPLETE;
+}
+
+/**
+ * @brief parses one "Name: value" header line, whitespace around the value is not part of the span
+ *
+ * @param parser
+ * @param buffer
+ * @param start
+ * @param end
+ * @return http_parse_result
+ */
+static http_parse_result http_parse_header(http_parser *parser, const char *buffer, size_t start, size_t end)
+{
+	if (buffer[start] == ' ' || buffer[start] == '\t')
+	{
+		// obsolete line folding
+		return HTTP_PARSE_ERROR;
+	}
+	if (parser->header_count == HTTP_MAX_HEADERS)
+	{
+		return HTTP_PARSE_TOO_LARGE;
+	}
+	size_t colon = start;
+	while (colon < end && buffer[colon] != ':')
+	{
+		if (buffer[colon] == ' ' || buffer[colon] == '\t' || buffer[colon] == '\0')
+		{
+			return HTTP_PARSE_ERROR;
+		}
+		colon++;
+	}
+	if (colon == end || colon == start)
+	{
+		return HTTP_PARSE_ERROR;
+	}
+	size_t value_start = colon + 1;
+	size_t value_end = end;
+	while (value_start < value_end && (buffer[value_start] == ' ' || buffer[value_start] == '\t'))
+	{
+		value_start++;
+	}
+	while (value_end > value_start && (buffer[value_end - 1] == ' ' || buffer[value_end - 1] == '\t'))
+	{
+		value_end--;
+	}
+	http_header *header = &parser->headers[parser->header_count++];
+	header->name.offset = start;
+	header->name.length = colon - start;
+	header->value.offset = value_start;
+	header->value.length = value_end - value_start;
+	return HTTP_PARSE_INCOMPLETE;
+}
+
+/**
+ * @brief continues parsing the head in the buffer, only the bytes which arrived since the last call are scanned
+ *
+ * @param parser
+ * @param buffer holds the head from its first byte on, it may already contain bytes after the head
+ * @param length number of valid bytes in the buffer
+ * @return http_parse_result
+ */
+static http_parse_result http_parse(http_parser *parser, const char *buffer, size_t length)
+{
+	if (parser->state == HTTP_DONE)
+	{
+		return HTTP_PARSE_DONE;
+	}
+	while (parser->offset < length)
+	{
+		const char *newline = memchr(buffer + parser->offset, '\n', length - parser->offset);
+		if (newline == NULL)
+		{
+			parser->offset = length;
+			break;
+		}
+		size_t start = parser->line_start;
+		size_t end = newline - buffer;
+		parser->offset = end + 1;
+		parser->line_start = parser->offset;
+		if (parser->offset > parser->max_header_size)
+		{
+			return HTTP_PARSE_TOO_LARGE;
+		}
+		if (end > start && buffer[end - 1] == '\r')
+		{
+			end--;
+		}
+
+		http_parse_result result;
+		if (parser->state == HTTP_START_LINE)
+		{
+			if (end == start)
+			{
+				// empty lines in front of a request are ignored
+				continue;
+			}
+			result = http_parse_start_line(parser, buffer, start, end);
+			parser->state = HTTP_HEADERS;
+		}
+		else if (end == start)
+		{
+			parser->state = HTTP_DONE;
+			parser->header_end = parser->offset;
+			return HTTP_PARSE_DONE;
+		}
+		else
+		{
+			result = http_parse_header(parser, buffer, start, end);
+		}
+		if (result != HTTP_PARSE_INCOMPLETE)
+		{
+			return result;
+		}
+	}
+	if (parser->offset >= parser->max_header_size)
+	{
+		return HTTP_PARSE_TOO_LARGE;
+	}
+	return HTTP_PARSE_INCOMPLETE;
+}
+
+/**
+ * @brief How the end of a message body is found
+ * HTTP_BODY_LENGTH the body has Content-Length bytes
+ * HTTP_BODY_CHUNKED the body is sent with Transfer-Encoding: chunked
+ * HTTP_BODY_CLOSE the body ends when the connection is closed
+ *
+ */
+typedef enum http_body_mode
+{
+	HTTP_BODY_LENGTH,
+	HTTP_BODY_CHUNKED,
+	HTTP_BODY_CLOSE
+} http_body_mode;
+
+typedef enum http_chunk_state
+{
+	HTTP_CHUNK_SIZE,
+	HTTP_CHUNK_EXTENSION,
+	HTTP_CHUNK_DATA,
+	HTTP_CHUNK_DATA_END,
+	HTTP_CHUNK_TRAILER_START,
+	HTTP_CHUNK_TRAILER
+} http_chunk_state;
+
+/**
+ * @brief State of one message body, remaining counts the bytes left of the body or of the current chunk
+ *
+ */
+typedef struct http_body
+{
+	http_body_mode mode;
+	http_chunk_state chunk_state;
+	unsigned long long remaining;
+	bool size_digits;
+	bool done;
+} http_body;
+
+/**
+ * @brief finds out how the body of the parsed response is delimited, responses to 1xx, 204 and 304 have none
+ *
+ * @param body
+ * @param parser of the complete response head
+ * @param buffer
+ * @return http_parse_result HTTP_PARSE_DONE or HTTP_PARSE_ERROR for a malformed length or an unknown transfer coding
+ */
+__attribute__((unused)) static http_parse_result http_body_init(http_body *body, const http_parser *parser, const char *buffer)
+{
+	memset(body, 0, sizeof(*body));
+	body->mode = HTTP_BODY_CLOSE;
+	const char *status = buffer + parser->status.offset;
+	if (parser->response && (status[0] == '1' || strncmp(status, "204", 3) == 0 || strncmp(status, "304", 3) == 0))
+	{
+		body->mode = HTTP_BODY_LENGTH;
+		body->done = true;
+		return HTTP_PARSE_DONE;
+	}
+	const http_header *transfer_encoding = http_find_header(parser, buffer, "Transfer-Encoding");
+	if (transfer_encoding != NULL)
+	{
+		// chunked has to be the last coding, everything in front of it isn't understood here
+		if (!http_span_equals(buffer, transfer_encoding->value, "chunked"))
+		{
+			return HTTP_PARSE_ERROR;
+		}
+		body->mode = HTTP_BODY_CHUNKED;
+		return HTTP_PARSE_DONE;
+	}
+	const http_header *content_length = http_find_header(parser, buffer, "Content-Length");
+	if (content_length != NULL)
+	{
+		if (content_length->value.length == 0 || content_length->value.length > 18)
+		{
+			return HTTP_PARSE_ERROR;
+		}
+		for (size_t i = 0; i < content_length->value.length; i++)
+		{
+			char c = buffer[content_length->value.offset + i];
+			if (c < '0' || c > '9')
+			{
+				return HTTP_PARSE_ERROR;
+			}
+			body->remaining = body->remaining * 10 + (c - '0');
+		}
+		body->mode = HTTP_BODY_LENGTH;
+		body->done = body->remaining == 0;
+	}
+	return HTTP_PARSE_DONE;
+}
+
+/**
+ * @brief returns the value of a hex digit
+ *
+ * @param c
+ * @return int the value or -1 if it is no hex digit
+ */
+static int http_hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * @brief decodes received body bytes in place, afterwards the first decoded bytes of data are content.
+ * Bytes behind the end of the body are not consumed, they belong to the next message
+ *
+ * @param body
+ * @param data
+ * @param length number of received bytes in data
+ * @param consumed is set to the number of bytes which belong to this body
+ * @param decoded is set to the number of content bytes which are now at the start of data
+ * @return http_parse_result HTTP_PARSE_DONE at the end of the body, HTTP_PARSE_INCOMPLETE if more is expected,
+ * HTTP_PARSE_ERROR for a malformed chunk
+ */
+__attribute__((unused)) static http_parse_result http_body_decode(http_body *body, char *data, size_t length, size_t *consumed, size_t *decoded)
+{
+	*consumed = 0;
+	*decoded = 0;
+	if (body->mode != HTTP_BODY_CHUNKED)
+	{
+		size_t n = length;
+		if (body->mode == HTTP_BODY_LENGTH && n > body->remaining)
+		{
+			n = body->remaining;
+		}
+		if (body->mode == HTTP_BODY_LENGTH)
+		{
+			body->remaining -= n;
+			body->done = body->remaining == 0;
+		}
+		*consumed = *decoded = n;
+		return body->done ? HTTP_PARSE_DONE : HTTP_PARSE_INCOMPLETE;
+	}
+	size_t i = 0;
+	size_t out = 0;
+	while (i < length && !body->done)
+	{
+		char c = data[i];
+		switch (body->chunk_state)
+		{
+		case HTTP_CHUNK_SIZE:
+			if (http_hex_value(c) != -1)
+			{
+				if (body->remaining >> 60 != 0)
+				{
+					return HTTP_PARSE_ERROR;
+				}
+				body->remaining = body->remaining * 16 + http_hex_value(c);
+				body->size_digits = true;
+				i++;
+				break;
+			}
+			if (!body->size_digits)
+			{
+				return HTTP_PARSE_ERROR;
+			}
+			body->chunk_state = HTTP_CHUNK_EXTENSION;
+			break;
+		case HTTP_CHUNK_EXTENSION:
+			// chunk extensions are ignored up to the end of the line
+			i++;
+			if (c == '\n')
+			{
+				body->size_digits = false;
+				body->chunk_state = body->remaining == 0 ? HTTP_CHUNK_TRAILER_START : HTTP_CHUNK_DATA;
+			}
+			break;
+		case HTTP_CHUNK_DATA:
+		{
+			size_t n = length - i;
+			if (n > body->remaining)
+			{
+				n = body->remaining;
+			}
+			memmove(data + out, data + i, n);
+			out += n;
+			i += n;
+			body->remaining -= n;
+			if (body->remaining == 0)
+			{
+				body->chunk_state = HTTP_CHUNK_DATA_END;
+			}
+			break;
+		}
+		case HTTP_CHUNK_DATA_END:
+			i++;
+			if (c == '\n')
+			{
+				body->chunk_state = HTTP_CHUNK_SIZE;
+			}
+			else if (c != '\r')
+			{
+				return HTTP_PARSE_ERROR;
+			}
+			break;
+		case HTTP_CHUNK_TRAILER_START:
+			// trailer fields are skipped, an empty line ends the body
+			i++;
+			if (c == '\n')
+			{
+				body->done = true;
+			}
+			else if (c != '\r')
+			{
+				body->chunk_state = HTTP_CHUNK_TRAILER;
+			}
+			break;
+		case HTTP_CHUNK_TRAILER:
+			i++;
+			if (c == '\n')
+			{
+				body->chunk_state = HTTP_CHUNK_TRAILER_START;
+			}
+			break;
+		}
+	}
+	*consumed = i;
+	*decoded = out;
+	return body->done ? HTTP_PARSE_DONE : HTTP_PARSE_INCOMPLETE;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file metrics.c
+ * @author Maximilian Gaber 52009273
+ * @brief Request metrics of all workers. The slots of all workers live in one anonymous mapping which is shared
+ * between the processes, every worker only writes its own slot so counting needs neither locks nor atomic
+ * read-modify-write instructions. Any worker can read all slots to report them
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/**
+ * @brief Number of latency buckets, bucket i counts latencies up to 2^i microseconds and the last one everything
+ *
+ */
+#define METRICS_BUCKETS 28
+
+/**
+ * @brief Status codes which are counted on their own, all others are counted as "other"
+ *
+ */
+static const char *metrics_status_codes[] = {"200", "206", "400", "404", "416", "429", "431", "500", "501", "503", "other"};
+#define METRICS_STATUS_COUNT (sizeof(metrics_status_codes) / sizeof(metrics_status_codes[0]))
+
+/**
+ * @brief Counters of one worker, aligned to a cache line so workers don't write into the same line
+ * first_byte measures accept or arrival of the request until the first byte of the response is sent,
+ * last_byte measures the first until the last byte of the response
+ *
+ */
+typedef struct worker_metrics
+{
+	uint64_t connections;
+	uint64_t status[METRICS_STATUS_COUNT];
+	uint64_t aborted;
+	uint64_t bytes_sent;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t first_byte[METRICS_BUCKETS];
+	uint64_t first_byte_sum;
+	uint64_t last_byte[METRICS_BUCKETS];
+	uint64_t last_byte_sum;
+} __attribute__((aligned(64))) worker_metrics;
+
+typedef struct server_metrics
+{
+	worker_metrics *workers;
+	long worker_count;
+	worker_metrics *own;
+} server_metrics;
+
+/**
+ * @brief maps the shared slots, this has to happen before the workers are forked
+ *
+ * @param metrics
+ * @param workers
+ * @return int 0 on success -1 on error
+ */
+static int metrics_init(server_metrics *metrics, long workers)
+{
+	metrics->workers = mmap(NULL, workers * sizeof(worker_metrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (metrics->workers == MAP_FAILED)
+	{
+		metrics->workers = NULL;
+		return -1;
+	}
+	metrics->worker_count = workers;
+	metrics->own = &metrics->workers[0];
+	return 0;
+}
+
+/**
+ * @brief selects the slot the calling worker writes into
+ *
+ * @param metrics
+ * @param worker
+ */
+static void metrics_select(server_metrics *metrics, long worker)
+{
+	metrics->own = &metrics->workers[worker];
+}
+
+/**
+ * @brief adds to a counter of the own slot, there is only one writer so a relaxed load and store is enough
+ * and readers never see a torn value
+ *
+ * @param counter
+ * @param value
+ */
+static void metrics_add(uint64_t *counter, uint64_t value)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief reads a counter of any slot
+ *
+ * @param counter
+ * @return uint64_t
+ */
+static uint64_t metrics_read(const uint64_t *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief counts the latency in its bucket of the histogram
+ *
+ * @param histogram
+ * @param sum of all latencies in microseconds
+ * @param us
+ */
+static void metrics_observe(uint64_t *histogram, uint64_t *sum, uint64_t us)
+{
+	size_t bucket = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+	if (bucket >= METRICS_BUCKETS)
+	{
+		bucket = METRICS_BUCKETS - 1;
+	}
+	metrics_add(&histogram[bucket], 1);
+	metrics_add(sum, us);
+}
+
+/**
+ * @brief counts a finished response
+ *
+ * @param metrics
+ * @param code
+ */
+static void metrics_count_status(server_metrics *metrics, const char *code)
+{
+	size_t i = 0;
+	while (i < METRICS_STATUS_COUNT - 1 && strcmp(metrics_status_codes[i], code) != 0)
+	{
+		i++;
+	}
+	metrics_add(&metrics->own->status[i], 1);
+}
+
+/**
+ * @brief writes one counter of every worker
+ *
+ * @param out
+ * @param metrics
+ * @param name
+ * @param help
+ * @param offset of the counter in worker_metrics
+ */
+static void metrics_format_counter(FILE *out, server_metrics *metrics, const char *name, const char *help, size_t offset)
+{
+	fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+	for (long w = 0; w < metrics->worker_count; w++)
+	{
+		const uint64_t *counter = (const uint64_t *)((const char *)&metrics->workers[w] + offset);
+		fprintf(out, "%s{worker=\"%ld\"} %llu\n", name, w, (unsigned long long)metrics_read(counter));
+	}
+}
+
+/**
+ * @brief writes one latency histogram of every worker, buckets are cumulative
+ *
+ * @param out
+ * @param metrics
+ * @param name
+ * @param help
+ * @param histogram_offset of the histogram in worker_metrics
+ * @param sum_offset of the sum in worker_metrics
+ */
+static void metrics_format_histogram(FILE *out, server_metrics *metrics, const char *name, const char *help, size_t histogram_offset,
+									 size_t sum_offset)
+{
+	fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (long w = 0; w < metrics->worker_count; w++)
+	{
+		const uint64_t *histogram = (const uint64_t *)((const char *)&metrics->workers[w] + histogram_offset);
+		const uint64_t *sum = (const uint64_t *)((const char *)&metrics->workers[w] + sum_offset);
+		uint64_t count = 0;
+		for (size_t i = 0; i < METRICS_BUCKETS; i++)
+		{
+			count += metrics_read(&histogram[i]);
+			if (i < METRICS_BUCKETS - 1)
+			{
+				fprintf(out, "%s_bucket{worker=\"%ld\",le=\"%g\"} %llu\n", name, w, (double)(1ULL << i) / 1e6, (unsigned long long)count);
+			}
+			else
+			{
+				fprintf(out, "%s_bucket{worker=\"%ld\",le=\"+Inf\"} %llu\n", name, w, (unsigned long long)count);
+			}
+		}
+		fprintf(out, "%s_sum{worker=\"%ld\"} %.6f\n", name, w, metrics_read(sum) / 1e6);
+		fprintf(out, "%s_count{worker=\"%ld\"} %llu\n", name, w, (unsigned long long)count);
+	}
+}
+
+/**
+ * @brief formats the metrics of all workers in the Prometheus text format
+ *
+ * @param metrics
+ * @param length is set to the length of the text
+ * @return char* which has to be freed or NULL on error
+ */
+static char *metrics_format(server_metrics *metrics, size_t *length)
+{
+	char *text = NULL;
+	FILE *out = open_memstream(&text, length);
+	if (out == NULL)
+	{
+		return NULL;
+	}
+	metrics_format_counter(out, metrics, "httpd_connections_total", "Accepted connections.", offsetof(worker_metrics, connections));
+	fprintf(out, "# HELP httpd_responses_total Finished responses by status code.\n# TYPE httpd_responses_total counter\n");
+	for (long w = 0; w < metrics->worker_count; w++)
+	{
+		for (size_t i = 0; i < METRICS_STATUS_COUNT; i++)
+		{
+			fprintf(out, "httpd_responses_total{worker=\"%ld\",code=\"%s\"} %llu\n", w, metrics_status_codes[i],
+					(unsigned long long)metrics_read(&metrics->workers[w].status[i]));
+		}
+	}
+	metrics_format_counter(out, metrics, "httpd_aborted_responses_total", "Responses which couldn't be sent completely.",
+						   offsetof(worker_metrics, aborted));
+	metrics_format_counter(out, metrics, "httpd_sent_bytes_total", "Bytes written to clients.", offsetof(worker_metrics, bytes_sent));
+	metrics_format_counter(out, metrics, "httpd_cache_hits_total", "Files answered from the file cache.", offsetof(worker_metrics, cache_hits));
+	metrics_format_counter(out, metrics, "httpd_cache_misses_total", "Files which had to be opened.", offsetof(worker_metrics, cache_misses));
+	metrics_format_histogram(out, metrics, "httpd_first_byte_seconds", "Time from accept or request arrival to the first response byte.",
+							 offsetof(worker_metrics, first_byte), offsetof(worker_metrics, first_byte_sum));
+	metrics_format_histogram(out, metrics, "httpd_last_byte_seconds", "Time from the first to the last response byte.",
+							 offsetof(worker_metrics, last_byte), offsetof(worker_metrics, last_byte_sum));
+	if (fclose(out) != 0)
+	{
+		free(text);
+		return NULL;
+	}
+	return text;
+}
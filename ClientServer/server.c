@@ -21,25 +21,249 @@
 #include <time.h>
 #include <getopt.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/wait.h>
+#include <sys/sysmacros.h>
+
+#include "filecache.c"
+#include "docindex.c"
+#include "httpparser.c"
+#include "metrics.c"
+#include "admission.c"
+#include "uring.c"
+
+/**
+ * @brief Maximum of events handled per epoll_wait call
+ *
+ */
+#define MAX_EVENTS 64
+
+/**
+ * @brief Maximum number of workers, every worker has its own listening socket which the parent binds before forking
+ *
+ */
+#define MAX_WORKERS 1024
+
+/**
+ * @brief Maximum of connections accepted per round, so a flood of new connections can't starve the open ones
+ *
+ */
+#define MAX_ACCEPTS 64
+
+/**
+ * @brief Size of the buffer a request header has to fit in
+ *
+ */
+#define REQUEST_BUFFER_SIZE 8192
+
+/**
+ * @brief Size of the buffer the response header is formatted into
+ *
+ */
+#define HEADER_BUFFER_SIZE 1024
+
+/**
+ * @brief Size of the buffer the body is streamed through
+ *
+ */
+#define BODY_BUFFER_SIZE 16384
+
+/**
+ * @brief Default capacity of the file cache of every worker in bytes
+ *
+ */
+#define DEFAULT_CACHE_SIZE (64L << 20)
+
+/**
+ * @brief Default number of requests answered on one persistent connection
+ *
+ */
+#define DEFAULT_MAX_REQUESTS 100
+
+/**
+ * @brief Default number of seconds an idle persistent connection is kept open
+ *
+ */
+#define DEFAULT_IDLE_TIMEOUT 5
+
+/**
+ * @brief Default number of seconds a client has to send the complete request header, counted from its first byte
+ * or from accept on a new connection
+ *
+ */
+#define DEFAULT_HEADER_TIMEOUT 10
+
+/**
+ * @brief Default number of seconds sending a response may stall without the client reading anything
+ *
+ */
+#define DEFAULT_WRITE_TIMEOUT 30
+
+/**
+ * @brief Files smaller than this are never compressed on the fly, the gzip framing would eat the savings
+ *
+ */
+#define GZIP_MIN_SIZE 256
+
+/**
+ * @brief Reserved path which answers with the metrics of all workers instead of a file
+ *
+ */
+#define METRICS_PATH "/__stats"
+
+/**
+ * @brief Submission queue entries of the io_uring ring of every worker
+ *
+ */
+#define URING_ENTRIES 256
+
+/**
+ * @brief Bytes of a file sent with one sendfile when io_uring is used, the window is only sent if its first and last
+ * page are in the page cache
+ *
+ */
+#define RESIDENT_WINDOW (256 * 1024)
+
+/**
+ * @brief Tags in the low bits of the user data of a submission, the rest is the connection pointer
+ *
+ */
+#define URING_OPEN 1
+#define URING_STATX 2
+#define URING_READ 3
+#define URING_TAG_MASK 3
 
 static char *program_name = "<not set>";
 static volatile sig_atomic_t quit = 0;
-static int sockfd;
+static volatile sig_atomic_t reload = 0;
+static int sockfd = -1;
+static time_t now;
+static time_t date_time = -1;
+static char date_header[64];
+static size_t date_header_len;
 
 typedef struct server_input
 {
 	char *port;
 	char *index;
 	char *doc_root;
+	long workers;
+	long cache_size;
+	long max_requests;
+	long idle_timeout;
+	long header_timeout;
+	long write_timeout;
+	long backlog;
+	long max_connections;
+	long max_per_address;
+	bool preload;
 } server_input;
 
 typedef struct server_response
 {
 	char *code;
 	char *description;
-	FILE *request_file;
+	int request_fd;
+	off_t file_size;
+	bool regular_file;
+	cache_entry *cache_entry;
+	ino_t ino;
+	struct timespec mtime;
+	off_t range_start;
+	off_t range_end;
+	bool gzip;
+	bool cache_hit;
+	bool stats;
+	char *generated;
 } server_response;
 
+/**
+ * @brief The states every connection runs through:
+ * read request -> open file -> (wait for file) -> prepare response -> send headers -> stream body
+ * files which aren't cached are opened asynchronously with io_uring if the kernel supports it
+ *
+ */
+typedef enum connection_state
+{
+	READ_REQUEST,
+	OPEN_FILE,
+	WAIT_FILE,
+	PREPARE_RESPONSE,
+	SEND_HEADERS,
+	SEND_BODY,
+	CLOSE_CONNECTION
+} connection_state;
+
+/**
+ * @brief One client connection and everything needed to resume it when the socket becomes ready again
+ * pending_ops counts the io_uring operations which are still running, their buffers live in the connection
+ * so it is only freed after the last one completed. progressed marks bytes sent or an io_uring completion since the
+ * write timeout was last refreshed
+ *
+ */
+typedef struct connection
+{
+	int fd;
+	connection_state state;
+	char request[REQUEST_BUFFER_SIZE];
+	size_t request_len;
+	http_parser parser;
+	size_t header_end;
+	long requests;
+	bool keep_alive;
+	time_t last_active;
+	bool progressed;
+	uint64_t request_start;
+	uint64_t first_byte;
+	char path[PATH_MAX];
+	server_response response;
+	char header[HEADER_BUFFER_SIZE];
+	struct iovec iov[4];
+	int iov_count;
+	char body[BODY_BUFFER_SIZE];
+	size_t body_len;
+	size_t body_sent;
+	off_t body_offset;
+	int pending_ops;
+	bool orphaned;
+	int uring_fd;
+	int uring_error;
+	struct statx uring_stat;
+	char *uring_buffer;
+	size_t uring_read;
+	uint32_t address_slot;
+	struct connection_list *list;
+	struct connection *prev;
+	struct connection *next;
+} connection;
+
+/**
+ * @brief Connections in the same phase, ordered by the start of their timeout so the tail expires first
+ *
+ */
+typedef struct connection_list
+{
+	connection *head;
+	connection *tail;
+	long timeout;
+} connection_list;
+
+static connection_list idle_connections;
+static connection_list header_connections;
+static connection_list write_connections;
+static admission admission_limits;
+static file_cache cache;
+static server_metrics metrics;
+static doc_index root_index;
+static uring ring = {.fd = -1};
+
 /**
  * @brief is called when signal is detected
  * 
@@ -59,6 +283,29 @@ static void listen_signal(void)
 	struct sigaction sa = {.sa_handler = handle_signal};
 	sigaction(SIGINT, &sa, NULL);
 	sigaction(SIGTERM, &sa, NULL);
+	// a client which goes away while its response is sent must not kill the worker, the write reports EPIPE
+	struct sigaction ignore = {.sa_handler = SIG_IGN};
+	sigaction(SIGPIPE, &ignore, NULL);
+}
+
+/**
+ * @brief is called when the doc root index should be rebuilt
+ *
+ * @param signal
+ */
+static void handle_reload(int signal)
+{
+	reload = 1;
+}
+
+/**
+ * @brief rebuilds the doc root index on SIGHUP
+ *
+ */
+static void listen_reload_signal(void)
+{
+	struct sigaction sa = {.sa_handler = handle_reload};
+	sigaction(SIGHUP, &sa, NULL);
 }
 
 /**
@@ -67,8 +314,13 @@ static void listen_signal(void)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: %s [-p PORT] [-i INDEX] DOC_ROOT\n", program_name);
-	fprintf(stderr, "EXAMPLE: %s -p 1280 -i index.html ˜/Documents/my_website/\n", program_name);
+	fprintf(stderr, "Usage: %s [-p PORT] [-i INDEX] [-w WORKERS] [-c CACHE_BYTES] [-k MAX_REQUESTS] [-t IDLE_SECONDS] [-r HEADER_SECONDS]\n"
+					"          [-s WRITE_SECONDS] [-l BACKLOG] [-m MAX_CONNECTIONS] [-a MAX_PER_ADDRESS] [-x] DOC_ROOT\n",
+			program_name);
+	fprintf(stderr, "-r and -s limit reading a request header and a stalled response, -m and -a limit the open connections of the\n"
+					"whole server and of one client address (0 = unlimited), connections over them get 503 or 429\n");
+	fprintf(stderr, "-x indexes DOC_ROOT at startup and on SIGHUP, files which aren't indexed are answered with 404\n");
+	fprintf(stderr, "EXAMPLE: %s -p 1280 -i index.html -w 4 -c 67108864 -k 100 -t 5 -m 10000 -a 64 ˜/Documents/my_website/\n", program_name);
 	exit(EXIT_FAILURE);
 }
 
@@ -83,6 +335,106 @@ static void exit_with_error(char *message)
 	exit(EXIT_FAILURE);
 }
 
+/**
+ * @brief parses a numeric option argument, calls usage if it is no number or smaller than min
+ *
+ * @param arg
+ * @param min
+ * @return long
+ */
+static long parse_number(char *arg, long min)
+{
+	char *end;
+	errno = 0;
+	long number = strtol(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || number < min)
+	{
+		fprintf(stderr, "[%s] ERROR: Invalid number %s!\n", program_name, arg);
+		usage();
+	}
+	return number;
+}
+
+/**
+ * @brief refreshes the shared Date header line, the string is only formatted again when the second changed
+ *
+ */
+static void update_date(void)
+{
+	if (date_time == now)
+	{
+		return;
+	}
+	struct tm tm;
+	gmtime_r(&now, &tm);
+	date_header_len = strftime(date_header, sizeof(date_header), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+	date_time = now;
+}
+
+/**
+ * @brief returns the monotonic time in microseconds
+ *
+ * @return uint64_t
+ */
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief returns the content type of the file depending on its extension
+ *
+ * @param path
+ * @return const char*
+ */
+static const char *content_type(const char *path)
+{
+	static const char *types[][2] = {
+		{".html", "text/html"},
+		{".htm", "text/html"},
+		{".css", "text/css"},
+		{".js", "application/javascript"},
+		{".json", "application/json"},
+		{".txt", "text/plain"},
+		{".xml", "application/xml"},
+		{".svg", "image/svg+xml"},
+		{".png", "image/png"},
+		{".jpg", "image/jpeg"},
+		{".jpeg", "image/jpeg"},
+		{".gif", "image/gif"},
+		{".ico", "image/x-icon"},
+		{".pdf", "application/pdf"},
+		{".wasm", "application/wasm"},
+	};
+	const char *extension = strrchr(path, '.');
+	if (extension != NULL && strchr(extension, '/') == NULL)
+	{
+		for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		{
+			if (strcasecmp(extension, types[i][0]) == 0)
+			{
+				return types[i][1];
+			}
+		}
+	}
+	return "application/octet-stream";
+}
+
+/**
+ * @brief checks if files with this path are worth compressing, media formats are already compressed
+ *
+ * @param path
+ * @return true for text, scripts, json, xml and svg
+ */
+static bool is_compressible(const char *path)
+{
+	const char *type = content_type(path);
+	return strncmp(type, "text/", strlen("text/")) == 0 || strcmp(type, "application/javascript") == 0 ||
+		   strcmp(type, "application/json") == 0 || strcmp(type, "application/xml") == 0 || strcmp(type, "image/svg+xml") == 0;
+}
+
 /**
  * @brief checks if directory exists
  * 
@@ -144,6 +496,10 @@ static int start_socket(server_input server_input)
 	}
 	int optval = 1;
 	setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+	if (server_input.workers > 1 && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+	{
+		exit_with_error("Couldn't share the port between workers!");
+	}
 	if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) < 0)
 	{
 		exit_with_error("Couldn't bind socket!");
@@ -153,224 +509,1925 @@ static int start_socket(server_input server_input)
 }
 
 /**
- * @brief handles all incoming requests
- * 
- * @param socket_file 
- * @param server_input 
- * @return server_response 
+ * @brief sets the O_NONBLOCK flag on the given file descriptor
+ *
+ * @param fd
+ * @return int 0 on success -1 on error
+ */
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags == -1)
+	{
+		return -1;
+	}
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * @brief checks if the request announces a body, every Transfer-Encoding and every Content-Length other than 0 does
+ *
+ * @param parser of the complete request head
+ * @param request
+ * @return true if the request has a body
+ */
+static bool request_has_body(const http_parser *parser, const char *request)
+{
+	for (size_t i = 0; i < parser->header_count; i++)
+	{
+		const http_header *header = &parser->headers[i];
+		if (http_span_equals(request, header->name, "Transfer-Encoding") ||
+			(http_span_equals(request, header->name, "Content-Length") && !http_span_equals(request, header->value, "0")))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief handles a completely received request header, on success the path of the requested file is
+ * written into the connection and the response code is 200. The connection stays open afterwards
+ * unless the client asked to close it, the request was malformed or max_requests is reached
+ *
+ * @param connection
+ * @param parse_result of the request header
+ * @param server_input
+ * @return server_response
  */
-static server_response handle_request(FILE *socket_file, server_input server_input)
+static server_response handle_request(connection *connection, http_parse_result parse_result, server_input server_input)
 {
 	server_response server_response;
 	server_response.code = "500";
 	server_response.description = "Internal Server Error";
-	char *line_buffer = NULL;
-	size_t line_buffer_size = 0;
-	if (getline(&line_buffer, &line_buffer_size, socket_file) == -1)
+	server_response.request_fd = -1;
+	server_response.file_size = 0;
+	server_response.regular_file = false;
+	server_response.cache_entry = NULL;
+	server_response.range_start = 0;
+	server_response.range_end = 0;
+	server_response.gzip = false;
+	server_response.cache_hit = false;
+	server_response.stats = false;
+	server_response.generated = NULL;
+
+	connection->keep_alive = false;
+	if (parse_result == HTTP_PARSE_TOO_LARGE)
 	{
-		fprintf(stderr, "[%s] ERROR: Couldn't read request header!\n", program_name);
-		while ((getline(&line_buffer, &line_buffer_size, socket_file)) != -1)
-		{
-			if (strcmp(line_buffer, "\r\n") == 0)
-				break;
-		}
-		free(line_buffer);
+		server_response.code = "431";
+		server_response.description = "Request Header Fields Too Large";
 		return server_response;
 	}
-
-	char *request_method = strtok(line_buffer, " ");
-	char *request_resource = strtok(NULL, " ");
-	char *protocol_version = strtok(NULL, "\r\n");
+	http_parser *parser = &connection->parser;
+	const char *request = connection->request;
+	connection->requests++;
+	const http_header *connection_header = http_find_header(parser, request, "Connection");
+	connection->keep_alive = connection->requests < server_input.max_requests &&
+							 (connection_header == NULL || !http_span_has_token(request, connection_header->value, "close"));
 
 	// 400 Bad Request
-	if (request_method == NULL || request_resource == NULL || protocol_version == NULL || strcmp(protocol_version, "HTTP/1.1") != 0)
+	if (parse_result != HTTP_PARSE_DONE || !http_span_equals(request, parser->version, "HTTP/1.1"))
 	{
 		server_response.code = "400";
 		server_response.description = "Bad request";
-		while ((getline(&line_buffer, &line_buffer_size, socket_file)) != -1)
-		{
-			if (strcmp(line_buffer, "\r\n") == 0)
-				break;
-		}
-		free(line_buffer);
+		connection->keep_alive = false;
 		return server_response;
 	}
 
-	// 501 NOT implemented
-	if (strcmp(request_method, "GET") != 0)
+	// 501 NOT implemented, a possible request body can't be skipped so the connection is closed
+	if (parser->method.length != 3 || strncmp(request + parser->method.offset, "GET", 3) != 0)
 	{
+		connection->keep_alive = false;
 		server_response.code = "501";
 		server_response.description = "Not implemented";
-		while ((getline(&line_buffer, &line_buffer_size, socket_file)) != -1)
-		{
-			if (strcmp(line_buffer, "\r\n") == 0)
-				break;
-		}
-		free(line_buffer);
 		return server_response;
 	}
 
-	char path[strlen(server_input.doc_root) + strlen(server_input.index) + strlen(request_resource)];
-	strcpy(path, server_input.doc_root);
-	strcat(path, "/");
-	if (strcmp(request_resource, "/") == 0)
+	// 400 Bad Request, a body of a GET isn't read so its bytes would be parsed as the next pipelined request
+	if (request_has_body(parser, request))
 	{
-		strcat(path, server_input.index);
+		server_response.code = "400";
+		server_response.description = "Bad request";
+		connection->keep_alive = false;
+		return server_response;
 	}
-	else
+
+	if (http_span_equals(request, parser->target, METRICS_PATH))
 	{
-		strcat(path, request_resource);
+		server_response.code = "200";
+		server_response.description = "OK";
+		server_response.stats = true;
+		return server_response;
 	}
 
-	// Find the requested file
-	FILE *request_file = fopen(path, "r");
-	if (request_file == NULL)
+	const char *resource = request + parser->target.offset;
+	int resource_len = parser->target.length;
+	if (resource_len == 1 && resource[0] == '/')
+	{
+		resource = server_input.index;
+		resource_len = strlen(server_input.index);
+	}
+	if (snprintf(connection->path, sizeof(connection->path), "%s/%.*s", server_input.doc_root, resource_len, resource) >= sizeof(connection->path))
 	{
 		server_response.code = "404";
 		server_response.description = "Not found";
-		while ((getline(&line_buffer, &line_buffer_size, socket_file)) != -1)
-		{
-			if (strcmp(line_buffer, "\r\n") == 0)
-				break;
-		}
-		free(line_buffer);
 		return server_response;
 	}
 
-	// Read request to end
-	while ((getline(&line_buffer, &line_buffer_size, socket_file)) != -1)
-	{
-		if (strcmp(line_buffer, "\r\n") == 0)
-			break;
-	}
-
-	free(line_buffer);
 	server_response.code = "200";
 	server_response.description = "OK";
-	server_response.request_file = request_file;
 	return server_response;
 }
 
 /**
- * @brief reads from the requested file and writes into the socket file
- * 
- * @param server_response 
- * @param socket_file 
+ * @brief reads from the socket until the whole request header is parsed, a pipelined request may already be
+ * completely in the buffer. header_end is set to the length of the request header
+ *
+ * @param connection
+ * @param parse_result is set to the result of the parser once the header is complete or invalid
+ * @return int 1 if the header is complete or invalid, 0 if the socket has no more data yet, -1 if the connection should be closed
  */
-static void read_write_response(server_response server_response, FILE *socket_file)
+static int read_request(connection *connection, http_parse_result *parse_result)
 {
-	char buffer[1024];
-	while (fgets(buffer, sizeof(buffer), server_response.request_file) != NULL)
+	while (true)
 	{
-		fputs(buffer, socket_file);
+		*parse_result = http_parse(&connection->parser, connection->request, connection->request_len);
+		if (*parse_result != HTTP_PARSE_INCOMPLETE)
+		{
+			connection->header_end = *parse_result == HTTP_PARSE_DONE ? connection->parser.header_end : connection->request_len;
+			return 1;
+		}
+		ssize_t n = read(connection->fd, connection->request + connection->request_len, sizeof(connection->request) - connection->request_len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		if (n == 0)
+		{
+			return -1;
+		}
+		if (connection->request_len == 0 && connection->request_start == 0)
+		{
+			connection->request_start = monotonic_us();
+		}
+		connection->request_len += n;
 	}
 }
 
 /**
- * @brief Gets the file size 
- * 
- * @param file 
- * @return size_t 
+ * @brief formats the ETag of the opened file, it changes whenever the file is replaced or modified
+ *
+ * @param response
+ * @param buffer
+ * @param size
  */
-static size_t get_file_size(FILE *file)
+static void format_etag(const server_response *response, char *buffer, size_t size)
 {
-	fseek(file, 0, SEEK_END);
-	size_t size = ftell(file);
-	fseek(file, 0, SEEK_SET);
-	return size;
+	snprintf(buffer, size, "\"%lx-%lx-%lx.%lx%s\"", (unsigned long)response->ino, (unsigned long)response->file_size,
+			 (unsigned long)response->mtime.tv_sec, (unsigned long)response->mtime.tv_nsec, response->gzip ? "-gz" : "");
 }
 
 /**
- * @brief writes message on success = 200
- * 
- * @param socket_file 
- * @param server_response 
+ * @brief formats the Last-Modified date of the opened file
+ *
+ * @param response
+ * @param buffer
+ * @param size
  */
-static void write_success(FILE *socket_file, server_response server_response)
+static void format_last_modified(const server_response *response, char *buffer, size_t size)
 {
-	char time_text[128];
-	time_t t = time(NULL);
-	struct tm *tmp;
-	tmp = gmtime(&t);
-	strftime(time_text, sizeof(time_text), "%a, %d %b %y %T %Z", tmp);
+	struct tm tm;
+	gmtime_r(&response->mtime.tv_sec, &tm);
+	strftime(buffer, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
 
-	fprintf(socket_file, "HTTP/1.1 %s %s\r\nDate: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n", server_response.code,
-			server_response.description, time_text, get_file_size(server_response.request_file));
-	read_write_response(server_response, socket_file);
+/**
+ * @brief formats the header lines which describe the file of the response itself, the gzip variant isn't offered for ranges
+ *
+ * @param path
+ * @param response
+ * @param buffer
+ * @param size
+ * @return size_t length of the header lines
+ */
+static size_t format_entity_headers(const char *path, const server_response *response, char *buffer, size_t size)
+{
+	char etag[64];
+	char last_modified[64];
+	format_etag(response, etag, sizeof(etag));
+	format_last_modified(response, last_modified, sizeof(last_modified));
+	const char *encoding = "Accept-Ranges: bytes\r\n";
+	if (response->gzip)
+	{
+		encoding = "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+	}
+	else if (is_compressible(path))
+	{
+		encoding = "Accept-Ranges: bytes\r\nVary: Accept-Encoding\r\n";
+	}
+	return snprintf(buffer, size, "Content-Type: %s\r\n%sETag: %s\r\nLast-Modified: %s\r\n", content_type(path), encoding, etag,
+					last_modified);
 }
 
+/**
+ * @brief formats the header lines which describe the opened file itself
+ *
+ * @param connection
+ * @param buffer
+ * @param size
+ * @return size_t length of the header lines
+ */
+static size_t entity_headers(connection *connection, char *buffer, size_t size)
+{
+	return format_entity_headers(connection->path, &connection->response, buffer, size);
+}
 
 /**
- * @brief flushes the code and description on error to the socket file
- * 
- * @param socket_file 
- * @param server_response 
+ * @brief formats the header lines of a file of the doc root index
+ *
+ * @param path
+ * @param file_stat
+ * @param buffer
+ * @param size
+ * @return size_t length of the header lines
  */
-static void write_error(FILE *socket_file, server_response server_response){
-	fprintf(socket_file, "HTTP/1.1 %s (%s)\r\nConnection: close\r\n\r\n", server_response.code, server_response.description);
-	fflush(socket_file);
+static size_t index_headers(const char *path, const struct stat *file_stat, char *buffer, size_t size)
+{
+	server_response response = {.file_size = file_stat->st_size, .ino = file_stat->st_ino, .mtime = file_stat->st_mtim, .gzip = false};
+	return format_entity_headers(path, &response, buffer, size);
 }
 
 /**
- * @brief listens to all connections until done 
- * 
- * @param sockfd 
- * @param server_input 
+ * @brief takes over a cached file as body of the response
+ *
+ * @param connection
+ * @param entry
  */
-static void listen_conncetions(int sockfd, server_input server_input)
+static void use_cache_entry(connection *connection, cache_entry *entry)
 {
-	if (listen(sockfd, 16) == -1)
-	{
-		exit_with_error("Couldn't listen to the socket!");
-	}
-	while (quit != 1)
+	connection->response.cache_entry = entry;
+	connection->response.file_size = entry->size;
+	connection->response.regular_file = true;
+	connection->response.ino = entry->ino;
+	connection->response.mtime = entry->mtime;
+	connection->response.gzip = entry->gzip;
+}
+
+/**
+ * @brief opens the file if it is a regular file
+ *
+ * @param path
+ * @param file_stat is filled on success
+ * @return int the file descriptor or -1
+ */
+static int open_regular_file(const char *path, struct stat *file_stat)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd != -1 && (fstat(fd, file_stat) == -1 || !S_ISREG(file_stat->st_mode)))
 	{
-		// Wait for a request and receive the socket
-		int connfd = accept(sockfd, NULL, NULL);
-		if (connfd == -1)
-		{
-			if (errno == EINTR)
-			{
-				fprintf(stderr, "[%s] ERROR: Couldn't connect: %s\n", program_name, strerror(errno));
-			}
-			continue;
-		}
-		FILE *socket_file = fdopen(connfd, "r+");
-		if (socket_file == NULL)
-		{
-			fprintf(stderr, "[%s] ERROR: Couldn't open socket file: %s\n", program_name, strerror(errno));
-			close(connfd);
-			continue;
-		}
-		// handle request
-		server_response server_response = handle_request(socket_file, server_input);
-		
-		if (strcmp(server_response.code, "200") == 0)
-		{
-			write_success(socket_file, server_response);
-		}
-		else
-		{
-			write_error(socket_file, server_response);
-		}
-		if (socket_file != NULL)
-		{
-			fclose(socket_file);
-		}
-		if (server_response.request_file != NULL)
-		{
-			fclose(server_response.request_file);
-		}
+		close(fd);
+		fd = -1;
 	}
+	return fd;
 }
 
 /**
- * @brief cleans up when program exited
- * 
+ * @brief tags the submission with the connection and the operation
+ *
+ * @param sqe
+ * @param connection
+ * @param op
  */
-static void clean_up(void)
+static void uring_prepare(struct io_uring_sqe *sqe, connection *connection, int op)
 {
-	close(sockfd);
+	sqe->user_data = (uint64_t)(uintptr_t)connection | op;
+	connection->pending_ops++;
+}
+
+/**
+ * @brief submits opening and stat of the requested file, the stat is linked so it only runs if the file could be opened
+ *
+ * @param connection
+ * @return true if the file is opened asynchronously, false if it has to be opened synchronously
+ */
+static bool submit_open(connection *connection)
+{
+	if (ring.fd == -1 || !uring_reserve(&ring, 2))
+	{
+		return false;
+	}
+	struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)connection->path;
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+	uring_prepare(sqe, connection, URING_OPEN);
+	sqe = uring_get_sqe(&ring);
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)connection->path;
+	sqe->len = STATX_BASIC_STATS;
+	sqe->off = (uint64_t)(uintptr_t)&connection->uring_stat;
+	uring_prepare(sqe, connection, URING_STATX);
+	connection->uring_fd = -1;
+	connection->uring_error = 0;
+	return true;
+}
+
+/**
+ * @brief submits a read from the given offset of the file
+ *
+ * @param connection
+ * @param fd
+ * @param buffer
+ * @param length
+ * @param offset
+ * @return true if the read was submitted
+ */
+static bool submit_read(connection *connection, int fd, char *buffer, size_t length, off_t offset)
+{
+	if (ring.fd == -1 || !uring_reserve(&ring, 1))
+	{
+		return false;
+	}
+	struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buffer;
+	sqe->len = length;
+	sqe->off = offset;
+	uring_prepare(sqe, connection, URING_READ);
+	return true;
+}
+
+/**
+ * @brief converts the fields of statx the server uses into a struct stat
+ *
+ * @param file_stat
+ * @param stx
+ */
+static void stat_from_statx(struct stat *file_stat, const struct statx *stx)
+{
+	memset(file_stat, 0, sizeof(*file_stat));
+	file_stat->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	file_stat->st_ino = stx->stx_ino;
+	file_stat->st_mode = stx->stx_mode;
+	file_stat->st_size = stx->stx_size;
+	file_stat->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	file_stat->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+/**
+ * @brief checks if the client gets the gzip encoded variant, ranges are always served from the file as it is
+ *
+ * @param connection
+ * @return true if the file is compressible and the client accepts gzip
+ */
+static bool wants_gzip(connection *connection)
+{
+	const http_header *accept_encoding = http_find_header(&connection->parser, connection->request, "Accept-Encoding");
+	return accept_encoding != NULL && http_find_header(&connection->parser, connection->request, "Range") == NULL &&
+		   is_compressible(connection->path) && http_accepts_coding(connection->request, accept_encoding->value, "gzip");
+}
+
+/**
+ * @brief looks for the gzip encoded variant of the requested file: a cached one, a precompressed sibling "file.gz"
+ * or the cached or mapped file compressed into the cache. Only files which are in memory are compressed, so nothing
+ * is read from disk for it. What was found is remembered in the entry of the file, so a file without encoded variant
+ * costs no system call after its first request. A sibling of a file without entry is only found through the doc root index
+ *
+ * @param connection
+ * @param identity is the cached or mapped entry of the file as it is or NULL
+ * @return true if the response body is the encoded variant, false if the file should be served as it is
+ */
+static bool open_gzip_file(connection *connection, cache_entry *identity)
+{
+	gzip_variant variant = identity != NULL ? identity->gzip_variant : GZIP_UNKNOWN;
+	if (variant == GZIP_NONE)
+	{
+		return false;
+	}
+	char gzip_path[PATH_MAX];
+	bool sibling = snprintf(gzip_path, sizeof(gzip_path), "%s.gz", connection->path) < (int)sizeof(gzip_path);
+	if (root_index.bucket_count != 0)
+	{
+		sibling = sibling && doc_index_find(&root_index, gzip_path) != NULL;
+	}
+	else
+	{
+		sibling = sibling && (variant == GZIP_SIBLING || (variant == GZIP_UNKNOWN && identity != NULL));
+	}
+	cache_entry *entry = sibling ? cache_lookup(&cache, gzip_path, true, now) : NULL;
+	if (entry != NULL)
+	{
+		use_cache_entry(connection, entry);
+		connection->response.cache_hit = true;
+		return true;
+	}
+
+	struct stat file_stat;
+	char headers[HEADER_BUFFER_SIZE];
+	int fd = sibling ? open_regular_file(gzip_path, &file_stat) : -1;
+	if (fd != -1)
+	{
+		if (identity != NULL)
+		{
+			identity->gzip_variant = GZIP_SIBLING;
+		}
+		connection->response.file_size = file_stat.st_size;
+		connection->response.regular_file = true;
+		connection->response.ino = file_stat.st_ino;
+		connection->response.mtime = file_stat.st_mtim;
+		connection->response.gzip = true;
+		entity_headers(connection, headers, sizeof(headers));
+		connection->response.cache_entry = cache_insert(&cache, gzip_path, true, fd, &file_stat, now, headers);
+		if (connection->response.cache_entry != NULL)
+		{
+			close(fd);
+			return true;
+		}
+		connection->response.request_fd = fd;
+		return true;
+	}
+
+	if (identity == NULL)
+	{
+		return false;
+	}
+	entry = cache_lookup(&cache, connection->path, true, now);
+	if (entry != NULL)
+	{
+		use_cache_entry(connection, entry);
+		connection->response.cache_hit = true;
+		return true;
+	}
+	identity->gzip_variant = GZIP_NONE;
+	if (identity->size < GZIP_MIN_SIZE)
+	{
+		return false;
+	}
+	// the ETag is derived from the file as it is, only Content-Length changes to the compressed size
+	connection->response.file_size = identity->file_size;
+	connection->response.ino = identity->ino;
+	connection->response.mtime = identity->mtime;
+	connection->response.gzip = true;
+	entity_headers(connection, headers, sizeof(headers));
+	entry = cache_insert_gzip(&cache, connection->path, identity, now, headers);
+	connection->response.gzip = false;
+	if (entry == NULL)
+	{
+		return false;
+	}
+	identity->gzip_variant = GZIP_COMPRESSED;
+	use_cache_entry(connection, entry);
+	return true;
+}
+
+/**
+ * @brief takes the requested file from the cache or opens it and tries to cache it, clients accepting gzip get
+ * the encoded variant of compressible files. If it doesn't exist or is a directory the response becomes 404.
+ * With a doc root index unknown files are rejected and mapped files are sent without any system call.
+ * Files which aren't cached are opened with io_uring if possible, the connection waits for the file then
+ *
+ * @param connection
+ */
+static void open_request_file(connection *connection)
+{
+	doc_entry *indexed = NULL;
+	if (root_index.bucket_count != 0)
+	{
+		indexed = doc_index_find(&root_index, connection->path);
+		if (indexed == NULL)
+		{
+			connection->response.code = "404";
+			connection->response.description = "Not found";
+			return;
+		}
+	}
+	cache_entry *entry;
+	if (indexed != NULL && indexed->mapped != NULL)
+	{
+		entry = indexed->mapped;
+		entry->refs++;
+	}
+	else
+	{
+		entry = cache_lookup(&cache, connection->path, false, now);
+	}
+	if (wants_gzip(connection) && open_gzip_file(connection, entry))
+	{
+		if (entry != NULL)
+		{
+			cache_release(entry);
+		}
+		return;
+	}
+	if (entry != NULL)
+	{
+		use_cache_entry(connection, entry);
+		connection->response.cache_hit = true;
+		return;
+	}
+	if (submit_open(connection))
+	{
+		connection->state = WAIT_FILE;
+		return;
+	}
+
+	struct stat file_stat;
+	int fd = open(connection->path, O_RDONLY | O_CLOEXEC);
+	if (fd != -1 && (fstat(fd, &file_stat) == -1 || S_ISDIR(file_stat.st_mode)))
+	{
+		close(fd);
+		fd = -1;
+	}
+	if (fd == -1)
+	{
+		connection->response.code = "404";
+		connection->response.description = "Not found";
+		return;
+	}
+	connection->response.file_size = file_stat.st_size;
+	connection->response.regular_file = S_ISREG(file_stat.st_mode);
+	connection->response.ino = file_stat.st_ino;
+	connection->response.mtime = file_stat.st_mtim;
+	char headers[HEADER_BUFFER_SIZE];
+	entity_headers(connection, headers, sizeof(headers));
+	connection->response.cache_entry = cache_insert(&cache, connection->path, false, fd, &file_stat, now, headers);
+	if (connection->response.cache_entry != NULL)
+	{
+		close(fd);
+		return;
+	}
+	connection->response.request_fd = fd;
+}
+
+/**
+ * @brief continues with the result of the asynchronous open: small files are read completely with io_uring and
+ * stored in the cache, all other files are sent from the opened file. If the file couldn't be read into the cache
+ * it is sent from the file as well
+ *
+ * @param connection
+ */
+static void finish_open_file(connection *connection)
+{
+	server_response *response = &connection->response;
+	struct stat file_stat;
+	if (connection->uring_error == 0)
+	{
+		stat_from_statx(&file_stat, &connection->uring_stat);
+	}
+	if (connection->uring_buffer != NULL)
+	{
+		// the read into the cache finished
+		char *body = connection->uring_buffer;
+		connection->uring_buffer = NULL;
+		if (connection->uring_error == 0)
+		{
+			char headers[HEADER_BUFFER_SIZE];
+			entity_headers(connection, headers, sizeof(headers));
+			response->cache_entry = cache_store(&cache, connection->path, false, &file_stat, now, headers, body, file_stat.st_size);
+		}
+		else
+		{
+			free(body);
+		}
+		connection->uring_error = 0;
+		if (response->cache_entry != NULL)
+		{
+			close(connection->uring_fd);
+		}
+		else
+		{
+			response->request_fd = connection->uring_fd;
+		}
+		connection->uring_fd = -1;
+		return;
+	}
+	if (connection->uring_error != 0 || S_ISDIR(file_stat.st_mode))
+	{
+		if (connection->uring_fd != -1)
+		{
+			close(connection->uring_fd);
+			connection->uring_fd = -1;
+		}
+		connection->uring_error = 0;
+		response->code = "404";
+		response->description = "Not found";
+		return;
+	}
+	response->file_size = file_stat.st_size;
+	response->regular_file = S_ISREG(file_stat.st_mode);
+	response->ino = file_stat.st_ino;
+	response->mtime = file_stat.st_mtim;
+	if (cache_accepts(&cache, &file_stat) && file_stat.st_size > 0)
+	{
+		connection->uring_buffer = malloc(file_stat.st_size);
+		connection->uring_read = 0;
+		if (connection->uring_buffer != NULL &&
+			submit_read(connection, connection->uring_fd, connection->uring_buffer, file_stat.st_size, 0))
+		{
+			return;
+		}
+		free(connection->uring_buffer);
+		connection->uring_buffer = NULL;
+	}
+	// empty files are cached without reading, all others which don't fit into the cache are sent from the file
+	char headers[HEADER_BUFFER_SIZE];
+	entity_headers(connection, headers, sizeof(headers));
+	if (file_stat.st_size == 0)
+	{
+		response->cache_entry = cache_insert(&cache, connection->path, false, connection->uring_fd, &file_stat, now, headers);
+	}
+	if (response->cache_entry != NULL)
+	{
+		close(connection->uring_fd);
+	}
+	else
+	{
+		response->request_fd = connection->uring_fd;
+	}
+	connection->uring_fd = -1;
+}
+
+/**
+ * @brief checks the If-Range header, the range is only served if the validator still matches the file
+ *
+ * @param connection
+ * @return true if the Range header should be used
+ */
+static bool if_range_matches(connection *connection)
+{
+	const char *request = connection->request;
+	const http_header *if_range = http_find_header(&connection->parser, request, "If-Range");
+	if (if_range == NULL)
+	{
+		return true;
+	}
+	char validator[64];
+	if (if_range->value.length > 0 && request[if_range->value.offset] == '"')
+	{
+		format_etag(&connection->response, validator, sizeof(validator));
+	}
+	else
+	{
+		format_last_modified(&connection->response, validator, sizeof(validator));
+	}
+	return if_range->value.length == strlen(validator) && strncmp(request + if_range->value.offset, validator, if_range->value.length) == 0;
+}
+
+/**
+ * @brief parses a "bytes=first-last" Range header of a regular file, a satisfiable range turns the response into
+ * 206 Partial Content and an unsatisfiable one into 416. Multiple ranges are answered with the whole file
+ *
+ * @param connection
+ */
+static void resolve_range(connection *connection)
+{
+	server_response *response = &connection->response;
+	response->range_start = 0;
+	response->range_end = response->file_size;
+	const char *request = connection->request;
+	const http_header *range = http_find_header(&connection->parser, request, "Range");
+	if (range == NULL || !response->regular_file || !if_range_matches(connection))
+	{
+		return;
+	}
+	char value[64];
+	if (range->value.length >= sizeof(value))
+	{
+		return;
+	}
+	memcpy(value, request + range->value.offset, range->value.length);
+	value[range->value.length] = '\0';
+	if (strncasecmp(value, "bytes=", strlen("bytes=")) != 0 || strchr(value, ',') != NULL)
+	{
+		return;
+	}
+	char *spec = value + strlen("bytes=");
+	char *dash = strchr(spec, '-');
+	if (dash == NULL)
+	{
+		return;
+	}
+	char *end;
+	long long first = -1;
+	long long last = -1;
+	if (dash != spec)
+	{
+		first = strtoll(spec, &end, 10);
+		if (end != dash || first < 0)
+			return;
+	}
+	if (dash[1] != '\0')
+	{
+		last = strtoll(dash + 1, &end, 10);
+		if (*end != '\0' || last < 0)
+			return;
+	}
+	if (first == -1)
+	{
+		// suffix range: the last bytes of the file
+		if (last <= 0)
+		{
+			last = -1;
+			first = response->file_size;
+		}
+		else
+		{
+			first = last > response->file_size ? 0 : response->file_size - last;
+			last = response->file_size - 1;
+		}
+	}
+	else if (last == -1 || last >= response->file_size)
+	{
+		last = response->file_size - 1;
+	}
+	else if (last < first)
+	{
+		return;
+	}
+	if (first >= response->file_size)
+	{
+		response->code = "416";
+		response->description = "Range Not Satisfiable";
+		return;
+	}
+	response->code = "206";
+	response->description = "Partial Content";
+	response->range_start = first;
+	response->range_end = last + 1;
+}
+
+/**
+ * @brief checks if the response has a body which is sent from the requested file
+ *
+ * @param response
+ * @return true for 200 and 206
+ */
+static bool is_success(server_response response)
+{
+	return strcmp(response.code, "200") == 0 || strcmp(response.code, "206") == 0;
+}
+
+/**
+ * @brief counts bytes written to the client, the first ones mark the end of the first byte phase
+ *
+ * @param connection
+ * @param n
+ */
+static void count_sent(connection *connection, size_t n)
+{
+	if (n > 0 && connection->first_byte == 0)
+	{
+		connection->first_byte = monotonic_us();
+	}
+	if (n > 0)
+	{
+		connection->progressed = true;
+	}
+	metrics_add(&metrics.own->bytes_sent, n);
+}
+
+/**
+ * @brief writes pending bytes of the buffer into the socket
+ *
+ * @param fd
+ * @param buffer
+ * @param length
+ * @param sent is advanced by the number of bytes written
+ * @return int 1 if everything is written, 0 if the socket is full, -1 on error
+ */
+static int write_pending(int fd, const char *buffer, size_t length, size_t *sent)
+{
+	while (*sent < length)
+	{
+		ssize_t n = write(fd, buffer + *sent, length - *sent);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		*sent += n;
+	}
+	return 1;
+}
+
+/**
+ * @brief writes the pending parts of the response with as few writev calls as possible, the iovecs
+ * are advanced in place so a partial write can be resumed
+ *
+ * @param connection
+ * @return int 1 if everything is written, 0 if the socket is full, -1 on error
+ */
+static int write_iov(connection *connection)
+{
+	struct iovec *iov = connection->iov;
+	int count = connection->iov_count;
+	while (count > 0)
+	{
+		ssize_t n = writev(connection->fd, iov, count);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			connection->iov_count = count;
+			memmove(connection->iov, iov, count * sizeof(*iov));
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		count_sent(connection, n);
+		while (count > 0 && (size_t)n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	connection->iov_count = 0;
+	return 1;
+}
+
+/**
+ * @brief reads from the requested file and writes into the socket until the file is sent or the socket is full,
+ * this copies through the body buffer and is only used for files sendfile can't handle
+ *
+ * @param connection
+ * @return int 1 if the whole file is sent, 0 if the socket is full, -1 on error
+ */
+static int read_write_response(connection *connection)
+{
+	while (true)
+	{
+		if (connection->body_sent == connection->body_len)
+		{
+			ssize_t n = read(connection->response.request_fd, connection->body, sizeof(connection->body));
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (n == 0)
+			{
+				return 1;
+			}
+			connection->body_len = n;
+			connection->body_sent = 0;
+		}
+		size_t sent = connection->body_sent;
+		int res = write_pending(connection->fd, connection->body, connection->body_len, &connection->body_sent);
+		count_sent(connection, connection->body_sent - sent);
+		if (res != 1)
+		{
+			return res;
+		}
+	}
+}
+
+/**
+ * @brief checks without blocking if the byte of the file is in the page cache
+ *
+ * @param fd
+ * @param offset
+ * @return true if it can be read without touching the disk
+ */
+static bool is_resident(int fd, off_t offset)
+{
+	char byte;
+	struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+	return preadv2(fd, &iov, 1, offset, RWF_NOWAIT) == 1;
+}
+
+/**
+ * @brief sends the requested file without ever blocking on the disk: windows whose first and last page are in the
+ * page cache are sent with sendfile, readahead brings the pages between them in together. All other parts are read
+ * with io_uring into the body buffer, the connection waits for the read and writes the buffer afterwards
+ *
+ * @param connection
+ * @return int 1 if the whole file is sent, 0 if the socket is full or a read is pending, -1 on error
+ */
+static int uring_file_response(connection *connection)
+{
+	int fd = connection->response.request_fd;
+	while (true)
+	{
+		if (connection->uring_error != 0)
+		{
+			errno = connection->uring_error;
+			return -1;
+		}
+		// what the last io_uring read brought in
+		size_t sent = connection->body_sent;
+		int res = write_pending(connection->fd, connection->body, connection->body_len, &connection->body_sent);
+		count_sent(connection, connection->body_sent - sent);
+		if (res != 1)
+		{
+			return res;
+		}
+		if (connection->body_offset >= connection->response.range_end)
+		{
+			return 1;
+		}
+		size_t length = connection->response.range_end - connection->body_offset;
+		if (length > RESIDENT_WINDOW)
+		{
+			length = RESIDENT_WINDOW;
+		}
+		if (is_resident(fd, connection->body_offset) && is_resident(fd, connection->body_offset + length - 1))
+		{
+			ssize_t n = sendfile(connection->fd, fd, &connection->body_offset, length);
+			if (n == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+			}
+			if (n == 0)
+			{
+				// file was truncated while sending, the promised length can't be delivered anymore
+				errno = EIO;
+				return -1;
+			}
+			count_sent(connection, n);
+			continue;
+		}
+		// not in the page cache or RWF_NOWAIT isn't supported, io_uring reports real errors
+		if (length > sizeof(connection->body))
+		{
+			length = sizeof(connection->body);
+		}
+		if (!submit_read(connection, fd, connection->body, length, connection->body_offset))
+		{
+			ssize_t n = pread(fd, connection->body, length, connection->body_offset);
+			if (n <= 0)
+			{
+				errno = n == 0 ? EIO : errno;
+				return -1;
+			}
+			connection->body_len = n;
+			connection->body_sent = 0;
+			connection->body_offset += n;
+			continue;
+		}
+		return 0;
+	}
+}
+
+/**
+ * @brief sends the requested file with sendfile directly from the page cache into the socket until the file is sent
+ * or the socket is full, non regular files fall back to read_write_response. With io_uring the file is sent by
+ * uring_file_response which only uses sendfile for parts in the page cache, so a cold file doesn't block the worker
+ *
+ * @param connection
+ * @return int 1 if the whole file is sent, 0 if the socket is full, -1 on error
+ */
+static int send_file_response(connection *connection)
+{
+	if (!connection->response.regular_file)
+	{
+		return read_write_response(connection);
+	}
+	if (ring.fd != -1)
+	{
+		return uring_file_response(connection);
+	}
+	while (connection->body_offset < connection->response.range_end)
+	{
+		ssize_t n = sendfile(connection->fd, connection->response.request_fd, &connection->body_offset,
+							 connection->response.range_end - connection->body_offset);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		if (n == 0)
+		{
+			// file was truncated while sending, the promised length can't be delivered anymore
+			return -1;
+		}
+		count_sent(connection, n);
+	}
+	return 1;
+}
+
+/**
+ * @brief returns the line which ends the header
+ *
+ * @param keep_alive
+ * @return const char*
+ */
+static const char *connection_line(bool keep_alive)
+{
+	return keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
+
+/**
+ * @brief prepares the response on success = 200, a cached file is answered with its prebuilt header, the shared Date
+ * line and its body in one writev, for all other files only the header is prepared and the body is sent afterwards
+ *
+ * @param connection
+ */
+static void write_success(connection *connection)
+{
+	cache_entry *entry = connection->response.cache_entry;
+	server_response *response = &connection->response;
+	connection->body_offset = response->range_start;
+	if (entry != NULL && strcmp(response->code, "200") == 0)
+	{
+		const char *end = connection_line(connection->keep_alive);
+		connection->iov[0].iov_base = entry->header;
+		connection->iov[0].iov_len = entry->header_len;
+		connection->iov[1].iov_base = date_header;
+		connection->iov[1].iov_len = date_header_len;
+		connection->iov[2].iov_base = (char *)end;
+		connection->iov[2].iov_len = strlen(end);
+		connection->iov[3].iov_base = entry->body;
+		connection->iov[3].iov_len = entry->size;
+		connection->iov_count = 4;
+		return;
+	}
+	size_t header_len;
+	char headers[HEADER_BUFFER_SIZE / 2];
+	entity_headers(connection, headers, sizeof(headers));
+	if (strcmp(response->code, "206") == 0)
+	{
+		header_len = snprintf(connection->header, sizeof(connection->header),
+							  "HTTP/1.1 206 Partial Content\r\nContent-Length: %lu\r\nContent-Range: bytes %lu-%lu/%lu\r\n%s%s%s",
+							  (unsigned long)(response->range_end - response->range_start), (unsigned long)response->range_start,
+							  (unsigned long)response->range_end - 1, (unsigned long)response->file_size, headers, date_header,
+							  connection_line(connection->keep_alive));
+	}
+	else if (!connection->response.regular_file)
+	{
+		// the length of pipes and devices is unknown, the body ends when the connection is closed
+		connection->keep_alive = false;
+		header_len = snprintf(connection->header, sizeof(connection->header), "HTTP/1.1 %s %s\r\nContent-Type: %s\r\n%s%s",
+							  connection->response.code, connection->response.description, content_type(connection->path),
+							  date_header, connection_line(false));
+	}
+	else
+	{
+		header_len = snprintf(connection->header, sizeof(connection->header), "HTTP/1.1 %s %s\r\nContent-Length: %lu\r\n%s%s%s",
+							  connection->response.code, connection->response.description, (unsigned long)connection->response.file_size,
+							  headers, date_header, connection_line(connection->keep_alive));
+	}
+	connection->iov[0].iov_base = connection->header;
+	connection->iov[0].iov_len = header_len;
+	connection->iov_count = 1;
+	if (entry != NULL)
+	{
+		// partial content of a cached file comes straight from its body
+		connection->iov[1].iov_base = entry->body + response->range_start;
+		connection->iov[1].iov_len = response->range_end - response->range_start;
+		connection->iov_count = 2;
+	}
+}
+
+/**
+ * @brief prepares the code and description on error as response
+ *
+ * @param connection
+ */
+static void write_error(connection *connection)
+{
+	char range[64] = "";
+	if (strcmp(connection->response.code, "416") == 0)
+	{
+		snprintf(range, sizeof(range), "Content-Range: bytes */%lu\r\n", (unsigned long)connection->response.file_size);
+	}
+	connection->iov[0].iov_base = connection->header;
+	connection->iov[0].iov_len = snprintf(connection->header, sizeof(connection->header), "HTTP/1.1 %s (%s)\r\nContent-Length: 0\r\n%s%s",
+										  connection->response.code, connection->response.description, range,
+										  connection_line(connection->keep_alive));
+	connection->iov_count = 1;
+}
+
+/**
+ * @brief prepares the response with the metrics of all workers
+ *
+ * @param connection
+ */
+static void write_stats(connection *connection)
+{
+	size_t length;
+	connection->response.generated = metrics_format(&metrics, &length);
+	if (connection->response.generated == NULL)
+	{
+		connection->response.code = "500";
+		connection->response.description = "Internal Server Error";
+		write_error(connection);
+		return;
+	}
+	connection->iov[0].iov_base = connection->header;
+	connection->iov[0].iov_len = snprintf(connection->header, sizeof(connection->header),
+										  "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n"
+										  "Cache-Control: no-store\r\n%s%s",
+										  (unsigned long)length, date_header, connection_line(connection->keep_alive));
+	connection->iov[1].iov_base = connection->response.generated;
+	connection->iov[1].iov_len = length;
+	connection->iov_count = 2;
+}
+
+/**
+ * @brief counts the finished response in the metrics of the worker
+ *
+ * @param connection
+ * @param complete false if the response couldn't be sent completely
+ */
+static void finish_response(connection *connection, bool complete)
+{
+	server_response *response = &connection->response;
+	uint64_t end = monotonic_us();
+	metrics_count_status(&metrics, response->code);
+	if (!complete)
+	{
+		metrics_add(&metrics.own->aborted, 1);
+	}
+	if (is_success(*response) && !response->stats)
+	{
+		metrics_add(response->cache_hit ? &metrics.own->cache_hits : &metrics.own->cache_misses, 1);
+	}
+	if (connection->first_byte != 0)
+	{
+		metrics_observe(metrics.own->first_byte, &metrics.own->first_byte_sum, connection->first_byte - connection->request_start);
+		metrics_observe(metrics.own->last_byte, &metrics.own->last_byte_sum, end - connection->first_byte);
+	}
+}
+
+/**
+ * @brief releases the requested file of the finished response
+ *
+ * @param connection
+ */
+static void release_response(connection *connection)
+{
+	if (connection->response.request_fd != -1)
+	{
+		close(connection->response.request_fd);
+		connection->response.request_fd = -1;
+	}
+	if (connection->response.cache_entry != NULL)
+	{
+		cache_release(connection->response.cache_entry);
+		connection->response.cache_entry = NULL;
+	}
+	free(connection->response.generated);
+	connection->response.generated = NULL;
+}
+
+/**
+ * @brief prepares the connection for the next request, bytes of an already pipelined request
+ * are moved to the start of the request buffer
+ *
+ * @param connection
+ */
+static void reset_connection(connection *connection)
+{
+	release_response(connection);
+	size_t pipelined = connection->request_len - connection->header_end;
+	memmove(connection->request, connection->request + connection->header_end, pipelined);
+	connection->request_len = pipelined;
+	// a pipelined request is already waiting, the next one starts with its first byte
+	connection->request_start = pipelined > 0 ? monotonic_us() : 0;
+	connection->first_byte = 0;
+	http_parser_init(&connection->parser, false, sizeof(connection->request));
+	connection->header_end = 0;
+	connection->iov_count = 0;
+	connection->body_len = connection->body_sent = 0;
+	connection->body_offset = 0;
+	connection->uring_error = 0;
+	connection->state = READ_REQUEST;
+}
+
+/**
+ * @brief finishes the error response and throws away what the client still sends, closing a socket with unread
+ * data would reset the connection and the client might never see the error response
+ *
+ * @param connection
+ */
+static void discard_request(connection *connection)
+{
+	shutdown(connection->fd, SHUT_WR);
+	for (int i = 0; i < 16; i++)
+	{
+		ssize_t n = read(connection->fd, connection->body, sizeof(connection->body));
+		if (n == 0 || (n == -1 && errno != EINTR))
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * @brief runs the state machine of the connection as far as the socket allows it
+ *
+ * @param connection
+ * @param server_input
+ */
+static void handle_connection(connection *connection, server_input server_input)
+{
+	int res;
+	http_parse_result parse_result;
+	if (connection->pending_ops > 0)
+	{
+		// the completion of the last io_uring operation resumes the connection
+		return;
+	}
+	while (true)
+	{
+		switch (connection->state)
+		{
+		case READ_REQUEST:
+			res = read_request(connection, &parse_result);
+			if (res == 0)
+				return;
+			if (res == -1)
+			{
+				connection->state = CLOSE_CONNECTION;
+				break;
+			}
+			connection->response = handle_request(connection, parse_result, server_input);
+			connection->state = OPEN_FILE;
+			break;
+		case OPEN_FILE:
+			if (connection->response.stats)
+			{
+				write_stats(connection);
+				connection->state = SEND_HEADERS;
+				break;
+			}
+			if (strcmp(connection->response.code, "200") == 0)
+			{
+				open_request_file(connection);
+				if (connection->state == WAIT_FILE)
+					return;
+			}
+			connection->state = PREPARE_RESPONSE;
+			break;
+		case WAIT_FILE:
+			finish_open_file(connection);
+			if (connection->pending_ops > 0)
+				return;
+			connection->state = PREPARE_RESPONSE;
+			break;
+		case PREPARE_RESPONSE:
+			if (strcmp(connection->response.code, "200") == 0)
+			{
+				resolve_range(connection);
+			}
+			if (is_success(connection->response))
+			{
+				write_success(connection);
+			}
+			else
+			{
+				write_error(connection);
+			}
+			connection->state = SEND_HEADERS;
+			break;
+		case SEND_HEADERS:
+			res = write_iov(connection);
+			if (res == 0)
+				return;
+			if (res == 1 && is_success(connection->response) && connection->response.request_fd != -1)
+			{
+				connection->state = SEND_BODY;
+				break;
+			}
+			finish_response(connection, res == 1);
+			if (res == 1 && connection->keep_alive)
+			{
+				reset_connection(connection);
+			}
+			else
+			{
+				if (res == 1)
+				{
+					discard_request(connection);
+				}
+				connection->state = CLOSE_CONNECTION;
+			}
+			break;
+		case SEND_BODY:
+			res = send_file_response(connection);
+			if (res == 0)
+				return;
+			if (res == -1)
+			{
+				fprintf(stderr, "[%s] ERROR: Couldn't send file: %s\n", program_name, strerror(errno));
+			}
+			finish_response(connection, res == 1);
+			if (res == 1 && connection->keep_alive)
+			{
+				reset_connection(connection);
+			}
+			else
+			{
+				connection->state = CLOSE_CONNECTION;
+			}
+			break;
+		case CLOSE_CONNECTION:
+			return;
+		}
+	}
+}
+
+/**
+ * @brief removes the connection from its connection list
+ *
+ * @param connection
+ */
+static void unlink_connection(connection *connection)
+{
+	connection_list *list = connection->list;
+	if (connection->prev != NULL)
+	{
+		connection->prev->next = connection->next;
+	}
+	else
+	{
+		list->head = connection->next;
+	}
+	if (connection->next != NULL)
+	{
+		connection->next->prev = connection->prev;
+	}
+	else
+	{
+		list->tail = connection->prev;
+	}
+	connection->list = NULL;
+}
+
+/**
+ * @brief puts the connection in front of the list, so the list stays ordered by the start of the timeout
+ * and the tail is always the connection which expires first
+ *
+ * @param connection
+ * @param list
+ */
+static void push_connection(connection *connection, connection_list *list)
+{
+	connection->last_active = now;
+	connection->list = list;
+	connection->prev = NULL;
+	connection->next = list->head;
+	if (list->head != NULL)
+	{
+		list->head->prev = connection;
+	}
+	list->head = connection;
+	if (list->tail == NULL)
+	{
+		list->tail = connection;
+	}
+}
+
+/**
+ * @brief moves the connection into the list of its phase: waiting for the next request on a persistent connection,
+ * reading a request header or answering. Idle connections are timed from their last activity and answering ones from
+ * their last progress, so a client which doesn't read can't keep the response alive by sending a byte now and then.
+ * A request header has to be complete within the header timeout no matter how often the client sends a few bytes
+ *
+ * @param connection
+ */
+static void track_connection(connection *connection)
+{
+	connection_list *list = &write_connections;
+	if (connection->state == READ_REQUEST)
+	{
+		list = connection->request_len == 0 && connection->requests > 0 ? &idle_connections : &header_connections;
+	}
+	if (connection->list == list && (list == &header_connections || (list == &write_connections && !connection->progressed)))
+	{
+		return;
+	}
+	connection->progressed = false;
+	if (connection->list != NULL)
+	{
+		unlink_connection(connection);
+	}
+	push_connection(connection, list);
+}
+
+/**
+ * @brief frees a closed connection after its last io_uring operation completed
+ *
+ * @param connection
+ */
+static void free_orphan(connection *connection)
+{
+	if (connection->uring_fd != -1)
+	{
+		close(connection->uring_fd);
+	}
+	free(connection->uring_buffer);
+	free(connection);
+}
+
+/**
+ * @brief closes the connection and its requested file and frees it, with pending io_uring operations
+ * it is only closed and freed by their last completion
+ *
+ * @param connection
+ */
+static void close_connection(connection *connection)
+{
+	release_response(connection);
+	close(connection->fd);
+	unlink_connection(connection);
+	admission_leave(&admission_limits, connection->address_slot);
+	if (connection->pending_ops > 0)
+	{
+		connection->orphaned = true;
+		return;
+	}
+	free(connection);
+}
+
+/**
+ * @brief closes all connections of the list whose timeout expired, a stalled response is aborted with a reset
+ * so the kernel doesn't keep the part the client never read
+ *
+ * @param list
+ */
+static void close_expired_connections(connection_list *list)
+{
+	while (list->tail != NULL && now - list->tail->last_active >= list->timeout)
+	{
+		connection *connection = list->tail;
+		if (connection->state == SEND_HEADERS || connection->state == SEND_BODY)
+		{
+			finish_response(connection, false);
+			struct linger linger = {.l_onoff = 1, .l_linger = 0};
+			setsockopt(connection->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+		}
+		close_connection(connection);
+	}
+}
+
+/**
+ * @brief closes all connections of the list
+ *
+ * @param list
+ */
+static void close_all_connections(connection_list *list)
+{
+	while (list->head != NULL)
+	{
+		close_connection(list->head);
+	}
+}
+
+/**
+ * @brief answers a connection which is over the limits right away and closes it, the response fits into the empty
+ * socket buffer so this never blocks. What the client already sent is read first, closing with unread data would
+ * reset the connection before the client sees the response
+ *
+ * @param connfd
+ * @param result
+ */
+static void reject_connection(int connfd, admission_result result)
+{
+	const char *response = result == REJECTED_FULL
+							   ? "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n"
+							   : "HTTP/1.1 429 Too Many Requests\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+	metrics_count_status(&metrics, result == REJECTED_FULL ? "503" : "429");
+	if (write(connfd, response, strlen(response)) > 0)
+	{
+		shutdown(connfd, SHUT_WR);
+		char discard[REQUEST_BUFFER_SIZE];
+		for (int i = 0; i < 16 && read(connfd, discard, sizeof(discard)) > 0; i++)
+			;
+	}
+	close(connfd);
+}
+
+/**
+ * @brief accepts pending connections and registers them edge triggered at the epoll instance, at most MAX_ACCEPTS per
+ * call so the open connections are served in between. Connections over the limits are rejected right away
+ *
+ * @param sockfd
+ * @param epfd
+ */
+static void accept_connections(int sockfd, int epfd)
+{
+	for (int i = 0; i < MAX_ACCEPTS; i++)
+	{
+		struct sockaddr_storage address;
+		socklen_t address_len = sizeof(address);
+		int connfd = accept4(sockfd, (struct sockaddr *)&address, &address_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (connfd == -1)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				fprintf(stderr, "[%s] ERROR: Couldn't connect: %s\n", program_name, strerror(errno));
+			}
+			return;
+		}
+		uint32_t address_slot = admission_slot(&address);
+		admission_result result = admission_enter(&admission_limits, address_slot);
+		if (result != ADMITTED)
+		{
+			reject_connection(connfd, result);
+			continue;
+		}
+		connection *connection = malloc(sizeof(*connection));
+		if (connection == NULL)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't allocate connection: %s\n", program_name, strerror(errno));
+			admission_leave(&admission_limits, address_slot);
+			close(connfd);
+			continue;
+		}
+		// responses are written in one piece, waiting for more data would only add latency
+		int optval = 1;
+		setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+		metrics_add(&metrics.own->connections, 1);
+		connection->fd = connfd;
+		connection->state = READ_REQUEST;
+		connection->request_len = 0;
+		http_parser_init(&connection->parser, false, sizeof(connection->request));
+		connection->header_end = 0;
+		connection->requests = 0;
+		connection->keep_alive = false;
+		connection->progressed = false;
+		connection->response.request_fd = -1;
+		connection->response.cache_entry = NULL;
+		connection->response.generated = NULL;
+		connection->request_start = monotonic_us();
+		connection->first_byte = 0;
+		connection->iov_count = 0;
+		connection->body_len = connection->body_sent = 0;
+		connection->body_offset = 0;
+		connection->pending_ops = 0;
+		connection->orphaned = false;
+		connection->uring_fd = -1;
+		connection->uring_error = 0;
+		connection->uring_buffer = NULL;
+		connection->address_slot = address_slot;
+		connection->list = NULL;
+		track_connection(connection);
+
+		struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = connection};
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, connfd, &event) == -1)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't watch connection: %s\n", program_name, strerror(errno));
+			close_connection(connection);
+		}
+	}
+}
+
+/**
+ * @brief takes over the result of an io_uring read, either into the cache buffer or into the body buffer
+ *
+ * @param connection
+ * @param res
+ */
+static void complete_read(connection *connection, int res)
+{
+	if (res <= 0)
+	{
+		// a read of 0 bytes means the file was truncated
+		connection->uring_error = res < 0 ? -res : EIO;
+		return;
+	}
+	if (connection->state == WAIT_FILE)
+	{
+		connection->uring_read += res;
+		size_t size = connection->response.file_size;
+		if (connection->uring_read < size && !connection->orphaned &&
+			!submit_read(connection, connection->uring_fd, connection->uring_buffer + connection->uring_read,
+						 size - connection->uring_read, connection->uring_read))
+		{
+			connection->uring_error = EAGAIN;
+		}
+		return;
+	}
+	connection->body_len = res;
+	connection->body_sent = 0;
+	connection->body_offset += res;
+}
+
+/**
+ * @brief handles all io_uring completions, a connection is resumed after its last pending operation
+ *
+ * @param server_input
+ * @return int number of completions
+ */
+static int complete_file_ops(server_input server_input)
+{
+	int count = 0;
+	struct io_uring_cqe cqe;
+	while (uring_next_cqe(&ring, &cqe))
+	{
+		count++;
+		connection *connection = (struct connection *)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_TAG_MASK);
+		switch (cqe.user_data & URING_TAG_MASK)
+		{
+		case URING_OPEN:
+			if (cqe.res >= 0)
+			{
+				connection->uring_fd = cqe.res;
+			}
+			else
+			{
+				connection->uring_error = -cqe.res;
+			}
+			break;
+		case URING_STATX:
+			if (cqe.res < 0 && connection->uring_error == 0)
+			{
+				connection->uring_error = -cqe.res;
+			}
+			break;
+		case URING_READ:
+			complete_read(connection, cqe.res);
+			break;
+		}
+		if (--connection->pending_ops > 0)
+		{
+			continue;
+		}
+		if (connection->orphaned)
+		{
+			free_orphan(connection);
+			continue;
+		}
+		connection->progressed = true;
+		handle_connection(connection, server_input);
+		if (connection->state == CLOSE_CONNECTION)
+		{
+			close_connection(connection);
+			continue;
+		}
+		track_connection(connection);
+	}
+	return count;
+}
+
+/**
+ * @brief rebuilds the doc root index, the old index is kept if that fails
+ *
+ * @param server_input
+ */
+static void rebuild_index(server_input server_input)
+{
+	doc_index rebuilt;
+	if (doc_index_build(&rebuilt, server_input.doc_root, index_headers) == -1)
+	{
+		fprintf(stderr, "[%s] ERROR: Couldn't rebuild the index of %s, the old one is kept!\n", program_name, server_input.doc_root);
+		return;
+	}
+	doc_index_free(&root_index);
+	root_index = rebuilt;
+}
+
+/**
+ * @brief listens to all connections until done, every connection is a non blocking state machine
+ * which is driven by an edge triggered epoll instance so no client can stall another one
+ *
+ * @param sockfd
+ * @param server_input
+ */
+static void listen_conncetions(int sockfd, server_input server_input)
+{
+	if (listen(sockfd, server_input.backlog) == -1)
+	{
+		exit_with_error("Couldn't listen to the socket!");
+	}
+	if (set_nonblocking(sockfd) == -1)
+	{
+		exit_with_error("Couldn't make the socket non blocking!");
+	}
+	cache_init(&cache, server_input.cache_size);
+	idle_connections.timeout = server_input.idle_timeout;
+	header_connections.timeout = server_input.header_timeout;
+	write_connections.timeout = server_input.write_timeout;
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+	{
+		exit_with_error("Couldn't create epoll instance!");
+	}
+	// the listening socket is the only event without a connection
+	struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = NULL};
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &listen_event) == -1)
+	{
+		exit_with_error("Couldn't watch the socket!");
+	}
+	// without io_uring files are opened synchronously and sent with sendfile
+	static const int ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ};
+	if (uring_init(&ring, URING_ENTRIES, ops, sizeof(ops) / sizeof(ops[0])) == 0)
+	{
+		// the ring becomes readable when completions are waiting
+		struct epoll_event ring_event = {.events = EPOLLIN, .data.ptr = &ring};
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, ring.fd, &ring_event) == -1)
+		{
+			uring_free(&ring);
+		}
+	}
+
+	struct epoll_event events[MAX_EVENTS];
+	bool retry_submit = false;
+	now = time(NULL);
+	update_date();
+	while (quit != 1)
+	{
+		// submissions the kernel didn't take yet are retried right away instead of after the next event
+		int n = epoll_wait(epfd, events, MAX_EVENTS, retry_submit ? 0 : 1000);
+		now = time(NULL);
+		update_date();
+		if (reload == 1)
+		{
+			reload = 0;
+			if (server_input.preload)
+			{
+				rebuild_index(server_input);
+			}
+		}
+		if (n == -1)
+		{
+			if (errno != EINTR)
+			{
+				fprintf(stderr, "[%s] ERROR: Couldn't wait for events: %s\n", program_name, strerror(errno));
+			}
+			continue;
+		}
+		for (int i = 0; i < n; i++)
+		{
+			connection *connection = events[i].data.ptr;
+			if (connection == NULL)
+			{
+				accept_connections(sockfd, epfd);
+				continue;
+			}
+			if (events[i].data.ptr == &ring)
+			{
+				// completions are handled after the events, together with the ones of this round
+				continue;
+			}
+			if (events[i].events & EPOLLERR)
+			{
+				connection->state = CLOSE_CONNECTION;
+			}
+			handle_connection(connection, server_input);
+			if (connection->state == CLOSE_CONNECTION)
+			{
+				close_connection(connection);
+				continue;
+			}
+			track_connection(connection);
+		}
+		// all operations of this round are submitted at once, completions may submit further reads
+		if (ring.fd != -1)
+		{
+			int submitted;
+			do
+			{
+				submitted = uring_submit(&ring);
+				if (submitted == -1)
+				{
+					fprintf(stderr, "[%s] ERROR: Couldn't submit to io_uring: %s\n", program_name, strerror(errno));
+				}
+			} while (complete_file_ops(server_input) > 0);
+			retry_submit = submitted == 0 && ring.queued > 0;
+		}
+		// only after the events are handled, so no event refers to a closed connection
+		close_expired_connections(&idle_connections);
+		close_expired_connections(&header_connections);
+		close_expired_connections(&write_connections);
+	}
+	close_all_connections(&idle_connections);
+	close_all_connections(&header_connections);
+	close_all_connections(&write_connections);
+	uring_free(&ring);
+	close(epfd);
+}
+
+/**
+ * @brief forks one worker per listening socket, every worker binds its own SO_REUSEPORT socket so the
+ * kernel spreads the connections over all of them. The parent waits until it receives SIGINT/SIGTERM
+ * (the quit flag) or all workers are gone and then terminates and reaps the remaining workers
+ *
+ * @param server_input
+ */
+static void start_workers(server_input server_input)
+{
+	int listeners[server_input.workers];
+	pid_t workers[server_input.workers];
+	// bind in the parent so a used port is reported once before anything is forked
+	for (long i = 0; i < server_input.workers; i++)
+	{
+		listeners[i] = start_socket(server_input);
+		// workers which aren't forked because a fork failed are never signalled or waited for
+		workers[i] = -1;
+	}
+	for (long i = 0; i < server_input.workers; i++)
+	{
+		workers[i] = fork();
+		if (workers[i] == -1)
+		{
+			fprintf(stderr, "[%s] ERROR: Couldn't fork worker: %s\n", program_name, strerror(errno));
+			quit = 1;
+			break;
+		}
+		if (workers[i] == 0)
+		{
+			for (long j = 0; j < server_input.workers; j++)
+			{
+				if (j != i)
+				{
+					close(listeners[j]);
+				}
+			}
+			sockfd = listeners[i];
+			metrics_select(&metrics, i);
+			listen_conncetions(sockfd, server_input);
+			exit(EXIT_SUCCESS);
+		}
+	}
+	for (long i = 0; i < server_input.workers; i++)
+	{
+		close(listeners[i]);
+	}
+
+	long running = 0;
+	for (long i = 0; i < server_input.workers && workers[i] != -1; i++)
+	{
+		running++;
+	}
+	while (quit != 1 && running > 0)
+	{
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid == -1)
+		{
+			if (errno == ECHILD)
+				break;
+			if (reload == 1)
+			{
+				// every worker has its own copy of the index
+				reload = 0;
+				for (long i = 0; i < server_input.workers; i++)
+				{
+					if (workers[i] > 0)
+					{
+						kill(workers[i], SIGHUP);
+					}
+				}
+			}
+			continue;
+		}
+		if (quit != 1)
+		{
+			fprintf(stderr, "[%s] ERROR: Worker %d terminated unexpectedly!\n", program_name, (int)pid);
+		}
+		for (long i = 0; i < server_input.workers; i++)
+		{
+			if (workers[i] == pid)
+			{
+				workers[i] = -1;
+			}
+		}
+		running--;
+	}
+	for (long i = 0; i < server_input.workers; i++)
+	{
+		if (workers[i] > 0)
+		{
+			kill(workers[i], SIGTERM);
+		}
+	}
+	for (long i = 0; i < server_input.workers; i++)
+	{
+		if (workers[i] > 0)
+		{
+			while (waitpid(workers[i], NULL, 0) == -1 && errno == EINTR)
+				;
+		}
+	}
+}
+
+/**
+ * @brief cleans up when program exited
+ * 
+ */
+static void clean_up(void)
+{
+	if (sockfd != -1)
+	{
+		close(sockfd);
+	}
 }
 
 /**
@@ -384,7 +2441,6 @@ static void clean_up(void)
 int main(int argc, char *argv[])
 {
 	program_name = argv[0];
-	int sockfd;
 	if (atexit(clean_up) < 0)
 	{
 		exit_with_error("Setting up clean_up function didn't work!");
@@ -392,10 +2448,29 @@ int main(int argc, char *argv[])
 	server_input server_input;
 	server_input.port = "8080";
 	server_input.index = "index.html";
+	server_input.workers = 1;
+	server_input.cache_size = DEFAULT_CACHE_SIZE;
+	server_input.max_requests = DEFAULT_MAX_REQUESTS;
+	server_input.idle_timeout = DEFAULT_IDLE_TIMEOUT;
+	server_input.header_timeout = DEFAULT_HEADER_TIMEOUT;
+	server_input.write_timeout = DEFAULT_WRITE_TIMEOUT;
+	server_input.backlog = SOMAXCONN;
+	server_input.max_connections = 0;
+	server_input.max_per_address = 0;
+	server_input.preload = false;
 	bool port_set = false;
 	bool index_set = false;
+	bool workers_set = false;
+	bool cache_size_set = false;
+	bool max_requests_set = false;
+	bool idle_timeout_set = false;
+	bool header_timeout_set = false;
+	bool write_timeout_set = false;
+	bool backlog_set = false;
+	bool max_connections_set = false;
+	bool max_per_address_set = false;
 	int opt;
-	while ((opt = getopt(argc, argv, "p:i:")) != -1)
+	while ((opt = getopt(argc, argv, "p:i:w:c:k:t:r:s:l:m:a:x")) != -1)
 	{
 		switch (opt)
 		{
@@ -417,6 +2492,100 @@ int main(int argc, char *argv[])
 			server_input.index = optarg;
 			index_set = true;
 			break;
+		case 'w':
+			if (workers_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.workers = parse_number(optarg, 1);
+			if (server_input.workers > MAX_WORKERS)
+			{
+				fprintf(stderr, "[%s] ERROR: At most %d workers are supported!\n", program_name, MAX_WORKERS);
+				usage();
+			}
+			workers_set = true;
+			break;
+		case 'c':
+			if (cache_size_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.cache_size = parse_number(optarg, 0);
+			cache_size_set = true;
+			break;
+		case 'k':
+			if (max_requests_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.max_requests = parse_number(optarg, 1);
+			max_requests_set = true;
+			break;
+		case 't':
+			if (idle_timeout_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.idle_timeout = parse_number(optarg, 1);
+			idle_timeout_set = true;
+			break;
+		case 'r':
+			if (header_timeout_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.header_timeout = parse_number(optarg, 1);
+			header_timeout_set = true;
+			break;
+		case 's':
+			if (write_timeout_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.write_timeout = parse_number(optarg, 1);
+			write_timeout_set = true;
+			break;
+		case 'l':
+			if (backlog_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.backlog = parse_number(optarg, 1);
+			backlog_set = true;
+			break;
+		case 'm':
+			if (max_connections_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.max_connections = parse_number(optarg, 0);
+			max_connections_set = true;
+			break;
+		case 'a':
+			if (max_per_address_set == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.max_per_address = parse_number(optarg, 0);
+			max_per_address_set = true;
+			break;
+		case 'x':
+			if (server_input.preload == true)
+			{
+				fprintf(stderr, "[%s] ERROR: Invalid options!", program_name);
+				usage();
+			}
+			server_input.preload = true;
+			break;
 		case '?':
 			usage();
 		default:
@@ -434,6 +2603,28 @@ int main(int argc, char *argv[])
 		check_path(server_input);
 	}
 	listen_signal();
+	if (server_input.preload)
+	{
+		// built before the workers are forked so they share the index until the first reload
+		if (doc_index_build(&root_index, server_input.doc_root, index_headers) == -1)
+		{
+			exit_with_error("Couldn't index the doc root!");
+		}
+		listen_reload_signal();
+	}
+	if (metrics_init(&metrics, server_input.workers) == -1)
+	{
+		exit_with_error("Couldn't map the metrics!");
+	}
+	if (admission_init(&admission_limits, server_input.max_connections, server_input.max_per_address) == -1)
+	{
+		exit_with_error("Couldn't map the connection counters!");
+	}
+	if (server_input.workers > 1)
+	{
+		start_workers(server_input);
+		exit(EXIT_SUCCESS);
+	}
 	sockfd = start_socket(server_input);
 	listen_conncetions(sockfd, server_input);
 	exit(EXIT_SUCCESS);
@@ -0,0 +1,258 @@
+/**
+ * @file uring.c
+ * @author Maximilian Gaber 52009273
+ * @brief Minimal io_uring ring on top of the raw system calls, the server uses it to open, stat and read files
+ * without blocking on the disk. Submissions are queued and handed to the kernel in one batch
+ * @version 0.1
+ * @date 2023-01-14
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief The mapped submission and completion queues of one ring, fd is -1 if io_uring can't be used
+ * queued counts submissions which are prepared but not handed to the kernel yet
+ *
+ */
+typedef struct uring
+{
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned queued;
+} uring;
+
+/**
+ * @brief unmaps the queues and closes the ring
+ *
+ * @param ring
+ */
+static void uring_free(uring *ring)
+{
+	if (ring->sqes != NULL)
+	{
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+	{
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring != NULL)
+	{
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if (ring->fd != -1)
+	{
+		close(ring->fd);
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+/**
+ * @brief checks if the kernel supports all operations
+ *
+ * @param ring
+ * @param ops
+ * @param op_count
+ * @return true if every operation is supported
+ */
+static bool uring_supports(uring *ring, const int *ops, size_t op_count)
+{
+	size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, size);
+	if (probe == NULL || syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+	{
+		free(probe);
+		return false;
+	}
+	bool supported = true;
+	for (size_t i = 0; i < op_count; i++)
+	{
+		if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+		{
+			supported = false;
+		}
+	}
+	free(probe);
+	return supported;
+}
+
+/**
+ * @brief sets up a ring and maps its queues
+ *
+ * @param ring
+ * @param entries number of submission queue entries
+ * @param ops operations which have to be supported
+ * @param op_count
+ * @return int 0 on success, -1 if io_uring or one of the operations isn't available, the ring is unusable then
+ */
+static int uring_init(uring *ring, unsigned entries, const int *ops, size_t op_count)
+{
+	memset(ring, 0, sizeof(*ring));
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0)
+	{
+		ring->fd = -1;
+		return -1;
+	}
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		// both queues share one mapping
+		if (ring->cq_ring_size > ring->sq_ring_size)
+		{
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+	{
+		ring->sq_ring = NULL;
+		uring_free(ring);
+		return -1;
+	}
+	ring->cq_ring = ring->sq_ring;
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+		{
+			ring->cq_ring = NULL;
+			uring_free(ring);
+			return -1;
+		}
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+	{
+		ring->sqes = NULL;
+		uring_free(ring);
+		return -1;
+	}
+	char *sq = ring->sq_ring;
+	char *cq = ring->cq_ring;
+	ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	if (!uring_supports(ring, ops, op_count))
+	{
+		uring_free(ring);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief hands all queued submissions to the kernel without waiting for any completion
+ *
+ * @param ring
+ * @return int 0 on success, -1 on error, submissions which couldn't be handed over stay queued and queued stays
+ * bigger than 0 until a later call hands them over
+ */
+static int uring_submit(uring *ring)
+{
+	while (ring->queued > 0)
+	{
+		int n = syscall(__NR_io_uring_enter, ring->fd, ring->queued, 0, 0, NULL, 0);
+		if (n < 0)
+		{
+			return errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -1;
+		}
+		if (n == 0)
+		{
+			// the kernel takes nothing right now, the caller retries without waiting for events
+			return 0;
+		}
+		ring->queued -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief makes sure count submission queue entries are free, queued submissions are handed to the kernel if necessary
+ *
+ * @param ring
+ * @param count
+ * @return true if uring_get_sqe can be called count times
+ */
+static bool uring_reserve(uring *ring, unsigned count)
+{
+	if (*ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count > ring->sq_entries)
+	{
+		uring_submit(ring);
+	}
+	return *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count <= ring->sq_entries;
+}
+
+/**
+ * @brief returns a cleared submission queue entry which is submitted with the next uring_submit,
+ * the entry has to be reserved with uring_reserve
+ *
+ * @param ring
+ * @return struct io_uring_sqe*
+ */
+static struct io_uring_sqe *uring_get_sqe(uring *ring)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	// the kernel only looks at the queue in io_uring_enter, so the entry can still be filled after publishing it
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+	return sqe;
+}
+
+/**
+ * @brief takes the next completion from the queue
+ *
+ * @param ring
+ * @param cqe is filled with the completion
+ * @return true if there was a completion
+ */
+static bool uring_next_cqe(uring *ring, struct io_uring_cqe *cqe)
+{
+	unsigned head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+	*cqe = ring->cqes[head & *ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}